@@ -196,6 +196,9 @@ public:
 			{
 				wrBuffer->WriteChunk(&msg);
 				ReleaseMutex(syncMutex);
+#ifdef USE_COUNTERS
+				messagesWritten++;
+#endif
 			}
 		}
 	}
@@ -203,13 +206,27 @@ public:
 	LaunchpadMessage Read()
 	{
 		if(checkServer())
+		{
+#ifdef USE_COUNTERS
+			LaunchpadMessage msg = rdBuffer->ReadChunk();
+			if(msg.status != LaunchpadKeyStatus::keyNone)
+				messagesRead++;
+			return msg;
+#else
 			return rdBuffer->ReadChunk();
+#endif
+		}
 
 		LaunchpadMessage rv;
 		rv.status = LaunchpadKeyStatus::keyNone;
 		return rv;
 	}
 
+#ifdef USE_COUNTERS
+	uint64_t messagesRead = 0;
+	uint64_t messagesWritten = 0;
+#endif
+
 private:
 	void *pmemory;
 	uint32_t *pCommonMemory;
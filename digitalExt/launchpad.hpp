@@ -172,6 +172,16 @@ public:
 
 	bool Connected() { return comm->Connected(); }
 
+#ifdef USE_COUNTERS
+	// messages exchanged with the launchpad server since the last call
+	void TakeMessageCounts(uint64_t *read, uint64_t *written)
+	{
+		*read += comm->messagesRead;
+		*written += comm->messagesWritten;
+		comm->messagesRead = comm->messagesWritten = 0;
+	}
+#endif
+
 	void LedRGB(int lp, int page, int r, int c, int c_r, int c_g, int c_b) { return LedRGB(lp, page, ILaunchpadPro::RC2Key(r, c), c_r, c_g, c_b); }
 	void LedPulse(int lp, int page, int r, int c, int color) { return LedPulse(lp, page, ILaunchpadPro::RC2Key(r, c), color); }
 	void LedColor(int lp, int page, int r, int c, int color) { return LedColor(lp, page, ILaunchpadPro::RC2Key(r, c), color); }
@@ -0,0 +1,374 @@
+// step() microbenchmark: runs every model through an idle, a clocked and a
+// heavily modulated scenario and reports ns/sample and instructions/sample.
+// Results can be saved as a baseline and later runs checked against it.
+#include "host.hpp"
+#include "script.hpp"
+#include "common.hpp"
+#include <unistd.h>
+#include <time.h>
+#include <map>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+struct Scenario
+{
+	std::string model;
+	std::string name;
+	std::string script;
+
+	std::string Key() const { return model + "/" + name; }
+};
+
+struct Result
+{
+	double ns;
+	double instructions;     // < 0: not available
+};
+
+static std::string lines(const char *fmt, int first, int count, double hz, double hzInc)
+{
+	std::string rv;
+	char line[128];
+	for(int k = 0; k < count; k++)
+	{
+		snprintf(line, sizeof(line), fmt, first + k, hz + k * hzInc);
+		rv += line;
+	}
+	return rv;
+}
+
+static std::vector<Scenario> scenarios()
+{
+	std::vector<Scenario> rv;
+
+	// Klee: LOAD_INPUT 0, EXT_CLOCK_INPUT 1, RND_THRES_IN 2, RANGE_IN 3
+	rv.push_back({"Klee", "idle", ""});
+	rv.push_back({"Klee", "clocked",
+		"clock 1 8\n"
+		"param 32 1\nparam 37 1\nparam 43 1\n"
+		"at 1 pulse 0 4\n"});
+	rv.push_back({"Klee", "modulated",
+		"clock 1 2000\nclock 0 1 0.01\n"
+		"param 32 1\nparam 37 1\nparam 43 1\n"
+		"param 51 1\nparam 54 1\n"
+		"lfo 2 3 0 1\nlfo 3 0.5 0 2\nplfo 0 1 0 1\n"});
+	// KleePoly: same as Klee, four voices
+	rv.push_back({"KleePoly", "modulated",
+		"clock 1 2000\nclock 0 1 0.01\n"
+		"param 32 1\nparam 37 1\nparam 43 1\n"
+		"param 51 1\nparam 54 1\n"
+		"lfo 2 3 0 1\nlfo 3 0.5 0 2\nplfo 0 1 0 1\n"});
+
+	// M581: CLOCK 0, RESET 1
+	rv.push_back({"M581", "idle", ""});
+	rv.push_back({"M581", "clocked", "clock 0 8\n"});
+	rv.push_back({"M581", "modulated",
+		"clock 0 500\nclock 1 3 0.01\n"
+		"param 35 4\nparam 36 3\n"
+		"plfo 32 0.5 0.005 1\nplfo 16 2 0.001 1\n"});
+
+	// Z8K: RESET 0..9, DIR 10..19, CLOCK 20..29
+	rv.push_back({"Z8K", "idle", ""});
+	rv.push_back({"Z8K", "clocked", lines("clock %i %g\n", 20, 10, 8, 0)});
+	rv.push_back({"Z8K", "modulated",
+		lines("clock %i %g\n", 20, 10, 300, 100) +
+		lines("lfo %i %g 0 10\n", 10, 10, 1, 0.5) +
+		lines("clock %i %g 0.01\n", 0, 10, 2, 0.3)});
+
+	// Renato: XCLK 0, YCLK 1
+	rv.push_back({"Renato", "idle", ""});
+	rv.push_back({"Renato", "clocked", "clock 0 8\nclock 1 2\n"});
+	rv.push_back({"Renato", "modulated",
+		"clock 0 700\nclock 1 170\n"
+		"param 0 2\nparam 1 1\nparam 2 1\n"
+		"param 3 0\nparam 8 0\nparam 13 0\n"
+		"plfo 51 1 0.005 6\n"});
+
+	// Spiralone: RESET 0..4, INLENGHT 5..9, INSTRIDE 10..14, INXPOSE 15..19, CLOCK 20..24
+	rv.push_back({"Spiralone", "idle", ""});
+	rv.push_back({"Spiralone", "clocked", lines("clock %i %g\n", 20, 5, 8, 0)});
+	rv.push_back({"Spiralone", "modulated",
+		lines("clock %i %g\n", 20, 5, 400, 150) +
+		lines("lfo %i %g 0 5\n", 5, 15, 0.5, 0.2) +
+		lines("clock %i %g 0.01\n", 0, 5, 1, 0.5)});
+
+	// PWMClock has no inputs: it always runs, modulation goes through its params
+	rv.push_back({"PWMClock", "idle", ""});
+	rv.push_back({"PWMClock", "clocked", "param 3 220\n"});
+	rv.push_back({"PWMClock", "modulated", "plfo 2 5 0.1 0.9\nplfo 3 0.5 20 220\nplfo 4 1 0 9\n"});
+
+	return rv;
+}
+
+// user-space instruction counter, when the kernel allows it
+struct InstructionCounter
+{
+public:
+	InstructionCounter()
+	{
+		perf_event_attr attr = {};
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+	~InstructionCounter() { if(fd >= 0) close(fd); }
+
+	bool Available() { return fd >= 0; }
+	void Reset() { if(fd >= 0) ioctl(fd, PERF_EVENT_IOC_RESET, 0); }
+	void Start() { if(fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); }
+	void Stop() { if(fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0); }
+	long long Read()
+	{
+		long long count = 0;
+		if(fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+			return -1;
+		return count;
+	}
+
+private:
+	int fd;
+};
+
+static double now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The stimulus is rendered one block ahead so that only the input copy and
+// step() (or processBlock(), when blockSize > 0) are inside the measured
+// region. Params set by the script land at the start of the block they belong to.
+static Result run(Host &host, const Scenario &sc, long samples, int blockSize, bool scheduling, InstructionCounter &counter)
+{
+	const int BLOCK = blockSize > 0 ? blockSize : 1024;
+	ModuleWidget *widget = host.Create(sc.model.c_str());
+	Module *module = widget->module;
+	BlockModule *blockModule = blockSize > 0 ? dynamic_cast<BlockModule *>(module) : NULL;
+	if(blockModule != NULL)
+		blockModule->edgeScheduling = scheduling;
+	module->onSampleRateChange();
+
+	Script script;
+	std::string text = sc.script;
+	for(size_t pos = 0; pos < text.size();)
+	{
+		size_t end = text.find('\n', pos);
+		if(end == std::string::npos)
+			end = text.size();
+		script.Add(text.substr(pos, end - pos).c_str());
+		pos = end + 1;
+	}
+	script.Begin(module);
+
+	int numInputs = module->inputs.size();
+	int numOutputs = module->outputs.size();
+	std::vector<std::vector<float>> inBuffers(numInputs, std::vector<float>(BLOCK));
+	std::vector<std::vector<float>> outBuffers(numOutputs, std::vector<float>(BLOCK));
+	std::vector<const float *> in(numInputs);
+	std::vector<float *> out(numOutputs);
+	for(int k = 0; k < numInputs; k++)
+		in[k] = module->inputs[k].active ? inBuffers[k].data() : NULL;     // unconnected: no buffer
+	for(int k = 0; k < numOutputs; k++)
+		out[k] = outBuffers[k].data();
+
+	double elapsed = 0;
+	counter.Reset();
+	for(long n = 0; n < samples; n += BLOCK)
+	{
+		int len = (int)std::min((long)BLOCK, samples - n);
+		for(int i = 0; i < len; i++)
+		{
+			script.Apply(module, n + i);
+			for(int k = 0; k < numInputs; k++)
+				inBuffers[k][i] = module->inputs[k].value;
+		}
+
+		double t0 = now_ns();
+		counter.Start();
+		if(blockModule != NULL)
+			blockModule->processBlock(in.data(), out.data(), len);
+		else
+		{
+			for(int i = 0; i < len; i++)
+			{
+				for(int k = 0; k < numInputs; k++)
+					module->inputs[k].value = inBuffers[k][i];
+				module->step();
+			}
+		}
+		counter.Stop();
+		elapsed += now_ns() - t0;
+	}
+
+	Result rv;
+	rv.ns = elapsed / samples;
+	long long instr = counter.Read();
+	rv.instructions = instr < 0 ? -1 : double(instr) / samples;
+	delete widget;
+	return rv;
+}
+
+static bool load_baseline(const char *filename, std::map<std::string, Result> *baseline)
+{
+	FILE *f = fopen(filename, "r");
+	if(f == NULL)
+		return false;
+
+	char line[256], key[128];
+	Result r;
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		if(sscanf(line, " \"%127[^\"]\": { \"ns\": %lf, \"instructions\": %lf", key, &r.ns, &r.instructions) == 3)
+			(*baseline)[key] = r;
+	}
+	fclose(f);
+	return true;
+}
+
+static bool save_baseline(const char *filename, float rate, long samples, const std::vector<std::pair<std::string, Result>> &results)
+{
+	FILE *f = fopen(filename, "w");
+	if(f == NULL)
+		return false;
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"sample_rate\": %g,\n", rate);
+	fprintf(f, "  \"samples\": %li,\n", samples);
+	fprintf(f, "  \"results\": {\n");
+	for(size_t k = 0; k < results.size(); k++)
+	{
+		fprintf(f, "    \"%s\": { \"ns\": %.3f, \"instructions\": %.1f }%s\n", results[k].first.c_str(),
+			results[k].second.ns, results[k].second.instructions, k + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  }\n}\n");
+	fclose(f);
+	return true;
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: bench [options]\n"
+		"  -n <samples>    samples per run (default: 524288)\n"
+		"  -r <rate>       sample rate in Hz (default: 44100)\n"
+		"  -k <runs>       runs per scenario, the best one is kept (default: 3)\n"
+		"  -f <model>      only benchmark this model\n"
+		"  -B <frames>     run through processBlock() in blocks of this size\n"
+		"  -E              no edge scheduling in processBlock()\n"
+		"  -w <file>       save the results as a baseline\n"
+		"  -b <file>       compare against a baseline\n"
+		"  -t <percent>    regression threshold (default: 10)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	long samples = 1 << 19;
+	float rate = 44100.0;
+	int runs = 3;
+	const char *filter = NULL;
+	const char *saveFile = NULL;
+	const char *baselineFile = NULL;
+	double threshold = 10.0;
+	int blockSize = 0;
+	bool scheduling = true;
+
+	int opt;
+	while((opt = getopt(argc, argv, "n:r:k:f:B:w:b:t:Eh")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n': samples = std::max(1L, atol(optarg)); break;
+		case 'r': rate = atof(optarg); break;
+		case 'k': runs = std::max(1, atoi(optarg)); break;
+		case 'f': filter = optarg; break;
+		case 'B': blockSize = std::max(0, atoi(optarg)); break;
+		case 'E': scheduling = false; break;
+		case 'w': saveFile = optarg; break;
+		case 'b': baselineFile = optarg; break;
+		case 't': threshold = atof(optarg); break;
+		default: usage(); return 1;
+		}
+	}
+	if(rate <= 0)
+	{
+		usage();
+		return 1;
+	}
+
+	std::map<std::string, Result> baseline;
+	if(baselineFile != NULL && !load_baseline(baselineFile, &baseline))
+	{
+		fprintf(stderr, "cannot read baseline %s\n", baselineFile);
+		return 1;
+	}
+
+	engineSetSampleRate(rate);
+	Host host;
+	InstructionCounter counter;
+	if(!counter.Available())
+		fprintf(stderr, "instruction counter not available, reporting time only\n");
+
+	std::vector<std::pair<std::string, Result>> results;
+	int regressions = 0;
+	printf("%-22s %12s %14s  %s\n", "scenario", "ns/sample", "instr/sample", baselineFile != NULL ? "vs baseline" : "");
+	for(const Scenario &sc : scenarios())
+	{
+		if(filter != NULL && strcasecmp(filter, sc.model.c_str()))
+			continue;
+
+		Result best = {0, -1};
+		for(int k = 0; k < runs; k++)
+		{
+			Result r = run(host, sc, samples, blockSize, scheduling, counter);
+			if(k == 0 || r.ns < best.ns)
+				best.ns = r.ns;
+			if(k == 0 || (r.instructions >= 0 && r.instructions < best.instructions))
+				best.instructions = r.instructions;
+		}
+		results.push_back(std::make_pair(sc.Key(), best));
+		if(best.instructions >= 0)
+			printf("%-22s %12.2f %14.1f", sc.Key().c_str(), best.ns, best.instructions);
+		else
+			printf("%-22s %12.2f %14s", sc.Key().c_str(), best.ns, "n/a");
+
+		auto it = baseline.find(sc.Key());
+		if(it != baseline.end())
+		{
+			const Result &base = it->second;
+			double dns = 100.0 * (best.ns - base.ns) / base.ns;
+			bool regressed = dns > threshold;
+			printf("  %+6.1f%% time", dns);
+			if(best.instructions >= 0 && base.instructions > 0)
+			{
+				double dinstr = 100.0 * (best.instructions - base.instructions) / base.instructions;
+				regressed |= dinstr > threshold;
+				printf(" %+6.1f%% instr", dinstr);
+			}
+			if(regressed)
+			{
+				printf("  REGRESSION");
+				regressions++;
+			}
+		}
+		printf("\n");
+	}
+
+	if(saveFile != NULL && !save_baseline(saveFile, rate, samples, results))
+	{
+		fprintf(stderr, "cannot write %s\n", saveFile);
+		return 1;
+	}
+
+	if(regressions > 0)
+	{
+		fprintf(stderr, "%i scenario(s) regressed by more than %g%%\n", regressions, threshold);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,196 @@
+// Klee state space explorer: runs the Klee module from every one of the
+// 65536 load patterns, on all the cores, and writes for each the cycle the
+// register falls into: the steps before it, its length, the distinct CV
+// A+B values and how often each bus is on. The index it writes is what
+// "Suggest Load Pattern" in the Klee context menu picks from.
+//
+// The knobs and switches come from a script (only its param lines count);
+// random injection is always off, so that every run is deterministic.
+#include "host.hpp"
+#include "Klee.hpp"
+#include "KleeModule.hpp"
+#include <unistd.h>
+#include <thread>
+#include <map>
+#include <set>
+
+static const int MAX_STEPS = 4096;    // a cycle not closed by then is written as 0
+
+struct Result
+{
+	int transient;    // steps before the cycle
+	int cycle;
+	int distinct;     // CV A+B values in the cycle
+	float density[3];
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: explore [options]\n"
+		"  -s <script>   knobs and switches (param lines only)\n"
+		"  -L <stages>   register length: 16, 32 or 64 (default 16)\n"
+		"  -b <n>        also try n random bus assignments\n"
+		"  -S <seed>     seed of the bus assignments (default 1)\n"
+		"  -j <threads>  worker threads (default: one per core)\n"
+		"  -o <file>     index file (default: TheXOR-Klee-index.txt)\n");
+}
+
+static void pulse(Klee *klee, int input)
+{
+	klee->inputs[input].value = 10.0;
+	klee->step();
+	klee->inputs[input].value = 0.0;
+	klee->step();
+}
+
+// loads the pattern and clocks the register until a state comes back
+static void explore(Klee *klee, uint16_t load, const float *bus, Result &result)
+{
+	for(int k = 0; k < 16; k++)
+	{
+		klee->params[Klee::LOAD_BUS + k].value = (load >> k) & 1;
+		klee->params[Klee::GROUPBUS + k].value = bus[k];
+	}
+	pulse(klee, Klee::LOAD_INPUT);
+
+	std::map<std::pair<uint64_t, uint8_t>, int> seen;
+	std::vector<Klee::HistoryEntry> steps;
+	result.transient = 0;
+	result.cycle = 0;
+	for(int n = 0; n < MAX_STEPS; n++)
+	{
+		pulse(klee, Klee::EXT_CLOCK_INPUT);
+		Klee::HistoryEntry entry;
+		if(klee->ReadHistory(&entry, 1) == 0)
+			break;    // the clock was not taken: written as no cycle
+		auto it = seen.emplace(std::make_pair(entry.reg, entry.bus), n);
+		if(!it.second)
+		{
+			result.transient = it.first->second;
+			result.cycle = n - result.transient;
+			break;
+		}
+		steps.push_back(entry);
+	}
+
+	std::set<float> values;
+	int on[3] = {0, 0, 0};
+	for(int n = result.transient; n < result.transient + result.cycle; n++)
+	{
+		values.insert(steps[n].cv[2]);
+		for(int k = 0; k < 3; k++)
+			on[k] += (steps[n].bus >> k) & 1;
+	}
+	result.distinct = values.size();
+	for(int k = 0; k < 3; k++)
+		result.density[k] = result.cycle > 0 ? on[k] / (float)result.cycle : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *scriptFile = NULL;
+	const char *outFile = "TheXOR-Klee-index.txt";
+	int length = 16;
+	int numBuses = 0;
+	unsigned seed = 1;
+	int numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	int opt;
+	while((opt = getopt(argc, argv, "s:L:b:S:j:o:h")) != -1)
+	{
+		switch(opt)
+		{
+		case 's': scriptFile = optarg; break;
+		case 'L': length = atoi(optarg); break;
+		case 'b': numBuses = std::max(0, atoi(optarg)); break;
+		case 'S': seed = strtoul(optarg, NULL, 0); break;
+		case 'j': numThreads = std::max(1, atoi(optarg)); break;
+		case 'o': outFile = optarg; break;
+		default: usage(); return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	srand(seed);
+	engineSetSampleRate(8000);
+	Host host;
+	Script script;
+	if(scriptFile != NULL && !script.Load(scriptFile))
+		return 1;
+
+	// an instance per thread, made here: SVG::load() and Font::load() are not thread safe
+	std::vector<ModuleWidget *> widgets;
+	for(int t = 0; t < numThreads; t++)
+	{
+		ModuleWidget *widget = host.Create("Klee");
+		Klee *klee = (Klee *)widget->module;
+		klee->onSampleRateChange();
+		script.Begin(klee);
+		script.Apply(klee, 0);
+		klee->params[Klee::RND_PAT].value = 0;
+		klee->setLength(length);
+		klee->inputs[Klee::LOAD_INPUT].active = true;
+		klee->inputs[Klee::EXT_CLOCK_INPUT].active = true;
+		klee->step();    // the triggers see a low first, or the first load and clock are lost
+		pulse(klee, Klee::EXT_CLOCK_INPUT);    // the length lands on a clock
+		widgets.push_back(widget);
+	}
+	Klee *first = (Klee *)widgets[0]->module;
+
+	// the bus assignment of the script, then the random ones
+	std::vector<std::vector<float>> buses(1 + numBuses, std::vector<float>(16));
+	RNG rng;
+	rng.Seed(seed);
+	for(int k = 0; k < 16; k++)
+		buses[0][k] = first->params[Klee::GROUPBUS + k].value;
+	for(int b = 1; b <= numBuses; b++)
+	{
+		for(int k = 0; k < 16; k++)
+			buses[b][k] = rng.Next() % 3;
+	}
+
+	const int numJobs = 65536 * (int)buses.size();
+	std::vector<Result> results(numJobs);
+	std::atomic<int> nextJob{0};
+	std::vector<std::thread> threads;
+	for(int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			Klee *klee = (Klee *)widgets[t]->module;
+			const int chunk = 256;
+			for(int job = nextJob.fetch_add(chunk); job < numJobs; job = nextJob.fetch_add(chunk))
+			{
+				for(int n = job; n < std::min(job + chunk, numJobs); n++)
+					explore(klee, n & 0xFFFF, buses[n >> 16].data(), results[n]);
+			}
+		}));
+	}
+	for(std::thread &thread : threads)
+		thread.join();
+
+	FILE *f = fopen(outFile, "w");
+	if(f == NULL)
+	{
+		fprintf(stderr, "cannot write %s\n", outFile);
+		return 1;
+	}
+	fprintf(f, "# Klee index: length %i, x28 %i, binv %i, bus2 %i, bus1load %i\n", length,
+		first->params[Klee::X28_X16].value >= 0.5, first->params[Klee::B_INV].value >= 0.5,
+		first->params[Klee::BUS2_MODE].value >= 0.5, first->params[Klee::BUS1_LOAD].value >= 0.5);
+	fprintf(f, "# load bus transient cycle distinct bus1 bus2 bus3\n");
+	for(int n = 0; n < numJobs; n++)
+	{
+		const Result &r = results[n];
+		char bus[17];
+		for(int k = 0; k < 16; k++)
+			bus[k] = '0' + (int)roundf(buses[n >> 16][k]);
+		bus[16] = '\0';
+		fprintf(f, "%04x %s %i %i %i %.4f %.4f %.4f\n", n & 0xFFFF, bus, r.transient, r.cycle, r.distinct, r.density[0], r.density[1], r.density[2]);
+	}
+	fclose(f);
+
+	for(ModuleWidget *widget : widgets)
+		delete widget;
+	return 0;
+}
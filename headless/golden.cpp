@@ -0,0 +1,213 @@
+// Golden-trace regression check: renders every case of the corpus and
+// compares the outputs with the recorded traces, sample by sample.
+//
+// The corpus manifest (<dir>/cases.txt) lists one case per line:
+//
+//   <name> <model> <rate> <samples>
+//
+// driven by the script <dir>/<name>.txt and recorded in <dir>/<name>.trace.
+// Cases render with a fixed random seed, so they give the same output on
+// any machine.
+#include "host.hpp"
+#include "trace.hpp"
+#include <unistd.h>
+
+struct Case
+{
+	std::string name;
+	std::string model;
+	float rate;
+	long samples;
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: golden [options] [case...]\n"
+		"       golden -c <trace> <trace>\n"
+		"  -d <dir>      corpus directory (default: corpus)\n"
+		"  -r            record the traces instead of checking them\n"
+		"  -b <frames>   render through processBlock() in blocks of this size\n"
+		"  -E            no edge scheduling in processBlock()\n"
+		"  -c            compare two trace files\n"
+		"  -v            list every diverging output, not only the first\n");
+}
+
+static bool load_cases(const std::string &dir, std::vector<Case> &cases)
+{
+	std::string filename = dir + "/cases.txt";
+	FILE *f = fopen(filename.c_str(), "r");
+	if(f == NULL)
+	{
+		warn("cannot open %s", filename.c_str());
+		return false;
+	}
+
+	char line[256], name[64], model[64];
+	int lineNumber = 0;
+	bool rv = true;
+	while(rv && fgets(line, sizeof(line), f) != NULL)
+	{
+		lineNumber++;
+		const char *p = line + strspn(line, " \t");
+		if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+			continue;
+		Case c;
+		if(sscanf(p, "%63s %63s %f %li", name, model, &c.rate, &c.samples) == 4 && c.rate > 0 && c.samples > 0)
+		{
+			c.name = name;
+			c.model = model;
+			cases.push_back(c);
+		} else
+		{
+			warn("%s:%i: cannot parse '%s'", filename.c_str(), lineNumber, strtok(line, "\r\n"));
+			rv = false;
+		}
+	}
+	fclose(f);
+	return rv;
+}
+
+// reports the outputs where b diverges from a; returns true when they match
+static bool compare(const Trace &a, const Trace &b, const char *name, bool verbose)
+{
+	bool rv = true;
+	if(a.model != b.model || a.samples != b.samples || a.outputs.size() != b.outputs.size())
+	{
+		printf("%s: trace is %s %li samples %i outputs, expected %s %li samples %i outputs\n", name,
+			b.model.c_str(), b.samples, (int)b.outputs.size(), a.model.c_str(), a.samples, (int)a.outputs.size());
+		rv = false;
+	}
+
+	int numOutputs = std::max(a.outputs.size(), b.outputs.size());
+	for(int k = 0; k < numOutputs; k++)
+	{
+		float va, vb;
+		long n = Trace::Diverge(a, b, k, &va, &vb);
+		if(n < 0)
+			continue;
+		printf("%s: output %i diverges at sample %li: expected %.9g, got %.9g\n", name, k, n, va, vb);
+		rv = false;
+		if(!verbose)
+			break;
+	}
+	return rv;
+}
+
+static bool render(Host &host, const std::string &dir, const Case &c, int blockSize, bool scheduling, Trace &trace)
+{
+	Script script;
+	if(!script.Load((dir + "/" + c.name + ".txt").c_str()))
+		return false;
+
+	// same starting point for every case, whatever ran before
+	srand(1);
+	engineSetSampleRate(c.rate);
+
+	ModuleWidget *widget = host.Create(c.model.c_str());
+	if(widget == NULL)
+	{
+		warn("%s: unknown model %s", c.name.c_str(), c.model.c_str());
+		return false;
+	}
+	Module *module = widget->module;
+	module->onSampleRateChange();
+	BlockModule *blockModule = dynamic_cast<BlockModule *>(module);
+	if(blockModule != NULL)
+		blockModule->edgeScheduling = scheduling;
+
+	trace.Begin(c.model.c_str(), c.rate, module->outputs.size());
+	Render(module, script, c.samples, blockSize, [&](long n, const float *values) { trace.Add(n, values); });
+
+	delete widget;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string dir = "corpus";
+	bool record = false;
+	bool compareFiles = false;
+	bool verbose = false;
+	int blockSize = 0;
+	bool scheduling = true;
+
+	int opt;
+	while((opt = getopt(argc, argv, "d:b:rcvEh")) != -1)
+	{
+		switch(opt)
+		{
+		case 'd': dir = optarg; break;
+		case 'r': record = true; break;
+		case 'b': blockSize = std::max(0, atoi(optarg)); break;
+		case 'E': scheduling = false; break;
+		case 'c': compareFiles = true; break;
+		case 'v': verbose = true; break;
+		default: usage(); return 1;
+		}
+	}
+
+	if(compareFiles)
+	{
+		if(argc - optind != 2)
+		{
+			usage();
+			return 1;
+		}
+		Trace a, b;
+		if(!a.Load(argv[optind]) || !b.Load(argv[optind + 1]))
+			return 1;
+		return compare(a, b, argv[optind + 1], verbose) ? 0 : 1;
+	}
+
+	std::vector<Case> cases;
+	if(!load_cases(dir, cases))
+		return 1;
+
+	// the cases named on the command line, or all of them
+	std::vector<Case> selected;
+	for(int k = optind; k < argc; k++)
+	{
+		auto it = std::find_if(cases.begin(), cases.end(), [&](const Case &c) { return c.name == argv[k]; });
+		if(it == cases.end())
+		{
+			warn("no case %s in %s/cases.txt", argv[k], dir.c_str());
+			return 1;
+		}
+		selected.push_back(*it);
+	}
+	if(selected.empty())
+		selected = cases;
+
+	Host host;
+	int failures = 0;
+	for(const Case &c : selected)
+	{
+		Trace trace;
+		std::string traceFile = dir + "/" + c.name + ".trace";
+		if(!render(host, dir, c, blockSize, scheduling, trace))
+		{
+			failures++;
+			continue;
+		}
+
+		if(record)
+		{
+			if(!trace.Save(traceFile.c_str()))
+				failures++;
+			else
+				printf("%s: recorded\n", c.name.c_str());
+			continue;
+		}
+
+		Trace expected;
+		if(!expected.Load(traceFile.c_str()) || !compare(expected, trace, c.name.c_str(), verbose))
+			failures++;
+		else
+			printf("%s: ok\n", c.name.c_str());
+	}
+
+	if(!record)
+		printf("%i of %i cases failed\n", failures, (int)selected.size());
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "rack.hpp"
+#include "script.hpp"
+#include "common.hpp"
+#include <string.h>
+
+using namespace rack;
+
+extern Plugin *plugin;
+extern void init(Plugin *p);
+
+// Registers the plugin models once and instantiates them by slug, the same
+// way Rack does when a module is added to the patch.
+struct Host
+{
+public:
+	Host()
+	{
+		plugin = new Plugin();
+		init(plugin);
+	}
+
+	~Host()
+	{
+		delete plugin;
+	}
+
+	Model *Find(const char *slug)
+	{
+		for(Model *model : plugin->models)
+		{
+			if(!strcasecmp(model->slug.c_str(), slug))
+				return model;
+		}
+		return NULL;
+	}
+
+	std::list<Model *> &Models() { return plugin->models; }
+
+	// the widget owns its module
+	ModuleWidget *Create(const char *slug)
+	{
+		Model *model = Find(slug);
+		return model == NULL ? NULL : model->createModuleWidget();
+	}
+};
+
+// Renders `samples` samples of the module driven by the script, calling
+// sink(n, outputs) with the output values of every sample. With blockSize > 0
+// it goes through processBlock(); blocks are cut where the script changes a
+// param, so the result matches the sample by sample rendering.
+template<class SINK> void Render(Module *module, Script &script, long samples, int blockSize, SINK sink)
+{
+	int numInputs = module->inputs.size();
+	int numOutputs = module->outputs.size();
+	BlockModule *blockModule = dynamic_cast<BlockModule *>(module);
+	script.Begin(module);
+
+	if(blockSize <= 0 || blockModule == NULL)
+	{
+		std::vector<float> values(numOutputs);
+		for(long n = 0; n < samples; n++)
+		{
+			script.Apply(module, n);
+			module->step();
+			for(int k = 0; k < numOutputs; k++)
+				values[k] = module->outputs[k].value;
+			sink(n, values.data());
+		}
+		return;
+	}
+
+	std::vector<std::vector<float>> inBuffers(numInputs, std::vector<float>(blockSize));
+	std::vector<std::vector<float>> outBuffers(numOutputs, std::vector<float>(blockSize));
+	std::vector<const float *> in(numInputs);
+	std::vector<float *> out(numOutputs);
+	std::vector<float> values(numOutputs);
+	for(int k = 0; k < numInputs; k++)
+		in[k] = module->inputs[k].active ? inBuffers[k].data() : NULL;     // unconnected: no buffer
+	for(int k = 0; k < numOutputs; k++)
+		out[k] = outBuffers[k].data();
+
+	for(long n = 0; n < samples;)
+	{
+		long len = std::min((long)blockSize, samples - n);
+		long next = script.NextParamChange(n + 1);
+		if(next < n + len)
+			len = next - n;
+
+		for(long i = 0; i < len; i++)
+		{
+			script.Apply(module, n + i);
+			for(int k = 0; k < numInputs; k++)
+				inBuffers[k][i] = module->inputs[k].value;
+		}
+
+		blockModule->processBlock(in.data(), out.data(), len);
+
+		for(long i = 0; i < len; i++)
+		{
+			for(int k = 0; k < numOutputs; k++)
+				values[k] = outBuffers[k][i];
+			sink(n + i, values.data());
+		}
+		n += len;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "rack.hpp"
+
+namespace rack {
+
+struct SchmittTrigger
+{
+	// UNKNOWN is used to represent a stable state when the previous state is not yet set
+	enum { UNKNOWN, LOW, HIGH } state = UNKNOWN;
+	float low = 0.0;
+	float high = 1.0;
+	void setThresholds(float low, float high)
+	{
+		this->low = low;
+		this->high = high;
+	}
+	/** Returns true if triggered */
+	bool process(float in)
+	{
+		switch(state)
+		{
+			case LOW:
+			if(in >= high)
+			{
+				state = HIGH;
+				return true;
+			}
+			break;
+			case HIGH:
+			if(in <= low)
+				state = LOW;
+			break;
+			default:
+			if(in >= high)
+				state = HIGH;
+			else if(in <= low)
+				state = LOW;
+			break;
+		}
+		return false;
+	}
+	bool isHigh() { return state == HIGH; }
+	void reset() { state = UNKNOWN; }
+};
+
+/** When triggered, holds a high value for a specified time before going low again */
+struct PulseGenerator
+{
+	float time = 0.0;
+	float pulseTime = 0.0;
+	/** Advances the state by `deltaTime`. Returns whether the pulse is in the HIGH state. */
+	bool process(float deltaTime)
+	{
+		time += deltaTime;
+		return time < pulseTime;
+	}
+	/** Begins a trigger with the given `pulseTime`. */
+	void trigger(float pulseTime)
+	{
+		// Keep the previous pulseTime if the existing pulse would be held longer than the currently requested one.
+		if(time + pulseTime >= this->pulseTime)
+		{
+			time = 0.0;
+			this->pulseTime = pulseTime;
+		}
+	}
+};
+
+} // namespace rack
@@ -0,0 +1,493 @@
+#pragma once
+// Minimal stand-in for the Rack 0.5 SDK, just enough to build the plugin
+// sources outside the engine. Engine types behave like the real ones;
+// widgets keep their geometry and param bindings but never draw anything.
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+
+#define TOSTRING_(x) #x
+#define TOSTRING(x) TOSTRING_(x)
+
+////////////////////
+// jansson
+////////////////////
+
+struct json_t;
+json_t *json_object();
+json_t *json_array();
+json_t *json_integer(long long value);
+json_t *json_real(double value);
+json_t *json_string(const char *value);
+int json_object_set_new(json_t *object, const char *key, json_t *value);
+json_t *json_object_get(const json_t *object, const char *key);
+int json_array_append_new(json_t *array, json_t *value);
+size_t json_array_size(const json_t *array);
+json_t *json_array_get(const json_t *array, size_t index);
+long long json_integer_value(const json_t *integer);
+double json_real_value(const json_t *real);
+double json_number_value(const json_t *number);
+const char *json_string_value(const json_t *string);
+void json_decref(json_t *json);
+#define JSON_INDENT(n) ((n) & 0x1F)
+int json_dump_file(const json_t *json, const char *path, size_t flags);
+
+////////////////////
+// nanovg
+////////////////////
+
+struct NVGcontext;
+struct NVGcolor { float r, g, b, a; };
+NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b);
+NVGcolor nvgRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+NVGcolor nvgTransRGBA(NVGcolor c, unsigned char a);
+inline void nvgBeginPath(NVGcontext *) {}
+inline void nvgRect(NVGcontext *, float, float, float, float) {}
+inline void nvgRoundedRect(NVGcontext *, float, float, float, float, float) {}
+inline void nvgCircle(NVGcontext *, float, float, float) {}
+inline void nvgFillColor(NVGcontext *, NVGcolor) {}
+inline void nvgFill(NVGcontext *) {}
+inline void nvgStrokeWidth(NVGcontext *, float) {}
+inline void nvgStrokeColor(NVGcontext *, NVGcolor) {}
+inline void nvgStroke(NVGcontext *) {}
+inline void nvgFontSize(NVGcontext *, float) {}
+inline void nvgFontFaceId(NVGcontext *, int) {}
+inline void nvgTextLetterSpacing(NVGcontext *, float) {}
+inline float nvgText(NVGcontext *, float x, float, const char *, const char *) { return x; }
+
+namespace rack {
+
+////////////////////
+// util
+////////////////////
+
+void info(const char *format, ...);
+void warn(const char *format, ...);
+uint32_t randomu32();
+float randomf();
+inline float clampf(float x, float min, float max) { return x < min ? min : (x > max ? max : x); }
+inline float rescalef(float x, float xMin, float xMax, float yMin, float yMax) { return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin); }
+
+struct Vec
+{
+	float x = 0.0, y = 0.0;
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+	Vec plus(Vec b) const { return Vec(x + b.x, y + b.y); }
+	Vec mult(float s) const { return Vec(x * s, y * s); }
+};
+
+struct Rect
+{
+	Vec pos;
+	Vec size;
+};
+
+inline Vec mm2px(Vec mm) { return mm.mult(75.0 / 25.4); }
+
+static const float RACK_GRID_WIDTH = 15;
+static const float RACK_GRID_HEIGHT = 380;
+
+static const NVGcolor COLOR_BLACK = {0, 0, 0, 1};
+static const NVGcolor COLOR_WHITE = {1, 1, 1, 1};
+static const NVGcolor COLOR_RED = {0.929, 0.204, 0.141, 1};
+static const NVGcolor COLOR_YELLOW = {0.992, 0.827, 0.180, 1};
+static const NVGcolor COLOR_GREEN = {0.541, 0.714, 0.082, 1};
+static const NVGcolor COLOR_BLUE = {0.161, 0.678, 0.980, 1};
+
+////////////////////
+// engine
+////////////////////
+
+struct Param { float value = 0.0; };
+struct Input { float value = 0.0; bool active = false; };
+struct Output { float value = 0.0; bool active = false; };
+struct Light
+{
+	float value = 0.0;
+	void setBrightness(float brightness) { value = brightness > 0.0 ? brightness * brightness : 0.0; }
+};
+
+struct Module
+{
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+	float cpuTime = 0.0;
+
+	Module() {}
+	Module(int numParams, int numInputs, int numOutputs, int numLights = 0)
+	{
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+	}
+	virtual ~Module() {}
+
+	virtual void step() {}
+	virtual void onSampleRateChange() {}
+	virtual void reset() {}
+	virtual void randomize() {}
+	virtual json_t *toJson() { return NULL; }
+	virtual void fromJson(json_t *root) {}
+};
+
+float engineGetSampleRate();
+float engineGetSampleTime();
+void engineSetSampleRate(float sampleRate);
+
+////////////////////
+// resources
+////////////////////
+
+struct SVG
+{
+	std::string path;
+	static std::shared_ptr<SVG> load(const std::string &filename);
+};
+
+struct Font
+{
+	int handle = -1;
+	static std::shared_ptr<Font> load(const std::string &filename);
+};
+
+////////////////////
+// widgets
+////////////////////
+
+struct EventAction { bool consumed = false; };
+
+struct Widget
+{
+	Rect box;
+	Widget *parent = NULL;
+	std::list<Widget *> children;
+	bool visible = true;
+
+	virtual ~Widget()
+	{
+		for(Widget *child : children)
+			delete child;
+	}
+	void addChild(Widget *widget)
+	{
+		widget->parent = this;
+		children.push_back(widget);
+	}
+	virtual void step() {}
+	virtual void draw(NVGcontext *vg) {}
+	virtual void onAction(EventAction &e) {}
+	virtual void onChange(EventAction &e) {}
+};
+
+struct TransparentWidget : virtual Widget {};
+struct OpaqueWidget : virtual Widget {};
+
+struct FramebufferWidget : virtual Widget
+{
+	bool dirty = true;
+};
+
+struct SVGWidget : virtual Widget
+{
+	std::shared_ptr<SVG> svg;
+	void wrap() {}
+	void setSVG(std::shared_ptr<SVG> svg) { this->svg = svg; }
+};
+
+struct Label : virtual Widget
+{
+	std::string text;
+};
+
+struct MenuEntry : OpaqueWidget {};
+struct MenuLabel : MenuEntry { std::string text; };
+struct MenuItem : MenuEntry
+{
+	std::string text;
+	std::string rightText;
+};
+struct Menu : OpaqueWidget {};
+
+struct QuantityWidget : virtual Widget
+{
+	float value = 0.0;
+	float minValue = 0.0;
+	float maxValue = 1.0;
+	float defaultValue = 0.0;
+
+	void setValue(float value)
+	{
+		this->value = clampf(value, fminf(minValue, maxValue), fmaxf(minValue, maxValue));
+		EventAction e;
+		onChange(e);
+	}
+	void setLimits(float minValue, float maxValue)
+	{
+		this->minValue = minValue;
+		this->maxValue = maxValue;
+	}
+	void setDefaultValue(float defaultValue)
+	{
+		this->defaultValue = defaultValue;
+		setValue(defaultValue);
+	}
+};
+
+struct ParamWidget : OpaqueWidget, QuantityWidget
+{
+	Module *module = NULL;
+	int paramId = 0;
+
+	virtual void randomize() { setValue(rescalef(randomf(), 0.0, 1.0, minValue, maxValue)); }
+	void onChange(EventAction &e) override
+	{
+		if(module)
+			module->params[paramId].value = value;
+	}
+};
+
+struct Knob : ParamWidget { bool snap = false; };
+struct SVGKnob : Knob, FramebufferWidget
+{
+	std::shared_ptr<SVG> svg;
+	void setSVG(std::shared_ptr<SVG> svg) { this->svg = svg; }
+};
+struct SVGSlider : Knob, FramebufferWidget
+{
+	Vec minHandlePos, maxHandlePos;
+	SVGWidget *background;
+	SVGWidget *handle;
+	SVGSlider()
+	{
+		background = new SVGWidget();
+		addChild(background);
+		handle = new SVGWidget();
+		addChild(handle);
+	}
+};
+struct SVGSwitch : virtual ParamWidget, FramebufferWidget
+{
+	std::vector<std::shared_ptr<SVG>> frames;
+	void addFrame(std::shared_ptr<SVG> svg) { frames.push_back(svg); }
+};
+struct ToggleSwitch : virtual ParamWidget {};
+struct MomentarySwitch : virtual ParamWidget {};
+
+struct Port : OpaqueWidget
+{
+	enum PortType { INPUT, OUTPUT };
+	Module *module = NULL;
+	PortType type = INPUT;
+	int portId = 0;
+};
+struct SVGPort : Port, FramebufferWidget
+{
+	SVGWidget *background;
+	SVGPort()
+	{
+		background = new SVGWidget();
+		addChild(background);
+	}
+};
+
+struct SVGScrew : FramebufferWidget {};
+struct SVGPanel : FramebufferWidget
+{
+	std::shared_ptr<SVG> background;
+	void setBackground(std::shared_ptr<SVG> svg) { background = svg; }
+};
+struct LightPanel : OpaqueWidget {};
+
+struct LightWidget : TransparentWidget
+{
+	NVGcolor bgColor = {};
+	NVGcolor color = {};
+};
+struct ModuleLightWidget : LightWidget
+{
+	Module *module = NULL;
+	int firstLightId = 0;
+	std::vector<NVGcolor> baseColors;
+	void addBaseColor(NVGcolor baseColor) { baseColors.push_back(baseColor); }
+};
+
+// component library
+struct Rogan : SVGKnob {};
+struct Rogan1PSWhite : Rogan {};
+struct Rogan1PSRed : Rogan {};
+struct Davies1900hBlackKnob : SVGKnob {};
+struct BefacoTinyKnob : SVGKnob {};
+struct Trimpot : SVGKnob {};
+struct BefacoSlidePot : SVGSlider {};
+struct NKK : SVGSwitch, ToggleSwitch {};
+struct CKSS : SVGSwitch, ToggleSwitch {};
+struct CKSSThree : SVGSwitch, ToggleSwitch {};
+struct BefacoPush : SVGSwitch, MomentarySwitch {};
+struct LEDButton : SVGSwitch, MomentarySwitch {};
+struct PJ301MPort : SVGPort {};
+struct ScrewSilver : SVGScrew {};
+
+struct GrayModuleLightWidget : ModuleLightWidget {};
+struct RedLight : GrayModuleLightWidget { RedLight() { addBaseColor(COLOR_RED); } };
+struct GreenLight : GrayModuleLightWidget { GreenLight() { addBaseColor(COLOR_GREEN); } };
+struct YellowLight : GrayModuleLightWidget { YellowLight() { addBaseColor(COLOR_YELLOW); } };
+struct BlueLight : GrayModuleLightWidget { BlueLight() { addBaseColor(COLOR_BLUE); } };
+template <typename BASE> struct LargeLight : BASE { LargeLight() { this->box.size = mm2px(Vec(5.179, 5.179)); } };
+template <typename BASE> struct MediumLight : BASE { MediumLight() { this->box.size = mm2px(Vec(3.176, 3.176)); } };
+template <typename BASE> struct SmallLight : BASE { SmallLight() { this->box.size = mm2px(Vec(2.176, 2.176)); } };
+template <typename BASE> struct TinyLight : BASE { TinyLight() { this->box.size = mm2px(Vec(1.088, 1.088)); } };
+
+struct Model;
+struct ModuleWidget : OpaqueWidget
+{
+	Model *model = NULL;
+	Module *module = NULL;
+	std::vector<ParamWidget *> params;
+	std::vector<Port *> inputs;
+	std::vector<Port *> outputs;
+
+	virtual ~ModuleWidget() { delete module; }
+	void setModule(Module *module) { this->module = module; }
+	void addParam(ParamWidget *param)
+	{
+		params.push_back(param);
+		addChild(param);
+	}
+	void addInput(Port *input)
+	{
+		inputs.push_back(input);
+		addChild(input);
+	}
+	void addOutput(Port *output)
+	{
+		outputs.push_back(output);
+		addChild(output);
+	}
+	virtual Menu *createContextMenu() { return new Menu(); }
+};
+
+template <class TParamWidget>
+TParamWidget *createParam(Vec pos, Module *module, int paramId, float minValue, float maxValue, float defaultValue)
+{
+	TParamWidget *param = new TParamWidget();
+	param->box.pos = pos;
+	param->module = module;
+	param->paramId = paramId;
+	param->setLimits(minValue, maxValue);
+	param->setDefaultValue(defaultValue);
+	return param;
+}
+
+template <class TPort>
+TPort *createInput(Vec pos, Module *module, int inputId)
+{
+	TPort *port = new TPort();
+	port->box.pos = pos;
+	port->module = module;
+	port->type = Port::INPUT;
+	port->portId = inputId;
+	return port;
+}
+
+template <class TPort>
+TPort *createOutput(Vec pos, Module *module, int outputId)
+{
+	TPort *port = new TPort();
+	port->box.pos = pos;
+	port->module = module;
+	port->type = Port::OUTPUT;
+	port->portId = outputId;
+	return port;
+}
+
+template <class TModuleLightWidget>
+TModuleLightWidget *createLight(Vec pos, Module *module, int firstLightId)
+{
+	TModuleLightWidget *light = new TModuleLightWidget();
+	light->box.pos = pos;
+	light->module = module;
+	light->firstLightId = firstLightId;
+	return light;
+}
+
+template <class TScrew>
+TScrew *createScrew(Vec pos)
+{
+	TScrew *screw = new TScrew();
+	screw->box.pos = pos;
+	return screw;
+}
+
+////////////////////
+// plugin
+////////////////////
+
+enum ModelTag
+{
+	NO_TAG,
+	CLOCK_TAG,
+	DIGITAL_TAG,
+	SEQUENCER_TAG,
+	UTILITY_TAG
+};
+
+struct Plugin;
+struct Model
+{
+	Plugin *plugin = NULL;
+	std::string manufacturerSlug, slug, name;
+	std::list<ModelTag> tags;
+	virtual ~Model() {}
+	virtual ModuleWidget *createModuleWidget() { return NULL; }
+};
+
+struct Plugin
+{
+	std::list<Model *> models;
+	std::string slug, version, website, manual;
+	std::string path;
+	virtual ~Plugin()
+	{
+		for(Model *model : models)
+			delete model;
+	}
+	void addModel(Model *model)
+	{
+		model->plugin = this;
+		models.push_back(model);
+	}
+};
+
+template <class TModuleWidget, typename... Tags>
+Model *createModel(std::string manufacturerSlug, std::string slug, std::string name, Tags... tags)
+{
+	struct TModel : Model
+	{
+		ModuleWidget *createModuleWidget() override
+		{
+			ModuleWidget *moduleWidget = new TModuleWidget();
+			moduleWidget->model = this;
+			return moduleWidget;
+		}
+	};
+	Model *model = new TModel();
+	model->manufacturerSlug = manufacturerSlug;
+	model->slug = slug;
+	model->name = name;
+	model->tags = {tags...};
+	return model;
+}
+
+std::string assetGlobal(std::string filename);
+std::string assetPlugin(Plugin *plugin, std::string filename);
+std::string assetLocal(std::string filename);
+
+} // namespace rack
@@ -0,0 +1,247 @@
+#include "rack.hpp"
+#include <stdarg.h>
+#include <stdio.h>
+#include <map>
+
+////////////////////
+// jansson
+////////////////////
+
+struct json_t
+{
+	enum { OBJECT, ARRAY, INTEGER, REAL, STRING } type;
+	long long integer = 0;
+	double real = 0.0;
+	std::string string;
+	std::map<std::string, json_t *> object;
+	std::vector<json_t *> array;
+};
+
+static json_t *json_new(int type)
+{
+	json_t *rv = new json_t();
+	rv->type = (decltype(rv->type))type;
+	return rv;
+}
+
+json_t *json_object() { return json_new(json_t::OBJECT); }
+json_t *json_array() { return json_new(json_t::ARRAY); }
+json_t *json_integer(long long value) { json_t *rv = json_new(json_t::INTEGER); rv->integer = value; return rv; }
+json_t *json_real(double value) { json_t *rv = json_new(json_t::REAL); rv->real = value; return rv; }
+json_t *json_string(const char *value) { json_t *rv = json_new(json_t::STRING); rv->string = value; return rv; }
+
+int json_object_set_new(json_t *object, const char *key, json_t *value)
+{
+	if(!object || object->type != json_t::OBJECT || !value)
+		return -1;
+	json_t *&slot = object->object[key];
+	json_decref(slot);
+	slot = value;
+	return 0;
+}
+
+json_t *json_object_get(const json_t *object, const char *key)
+{
+	if(!object || object->type != json_t::OBJECT)
+		return NULL;
+	auto it = object->object.find(key);
+	return it == object->object.end() ? NULL : it->second;
+}
+
+int json_array_append_new(json_t *array, json_t *value)
+{
+	if(!array || array->type != json_t::ARRAY || !value)
+		return -1;
+	array->array.push_back(value);
+	return 0;
+}
+
+size_t json_array_size(const json_t *array) { return (array && array->type == json_t::ARRAY) ? array->array.size() : 0; }
+json_t *json_array_get(const json_t *array, size_t index) { return index < json_array_size(array) ? array->array[index] : NULL; }
+long long json_integer_value(const json_t *integer) { return (integer && integer->type == json_t::INTEGER) ? integer->integer : 0; }
+double json_real_value(const json_t *real) { return (real && real->type == json_t::REAL) ? real->real : 0.0; }
+double json_number_value(const json_t *number)
+{
+	if(number && number->type == json_t::INTEGER)
+		return number->integer;
+	return json_real_value(number);
+}
+const char *json_string_value(const json_t *string) { return (string && string->type == json_t::STRING) ? string->string.c_str() : NULL; }
+
+void json_decref(json_t *json)
+{
+	if(!json)
+		return;
+	for(auto &it : json->object)
+		json_decref(it.second);
+	for(json_t *item : json->array)
+		json_decref(item);
+	delete json;
+}
+
+static void json_write(FILE *f, const json_t *json, int indent, int depth)
+{
+	auto newline = [&](int level)
+	{
+		if(indent > 0)
+			fprintf(f, "\n%*s", indent * level, "");
+	};
+
+	switch(json->type)
+	{
+	case json_t::OBJECT:
+	{
+		fprintf(f, "{");
+		bool first = true;
+		for(auto &it : json->object)
+		{
+			fprintf(f, first ? "" : ",");
+			newline(depth + 1);
+			fprintf(f, "\"%s\": ", it.first.c_str());
+			json_write(f, it.second, indent, depth + 1);
+			first = false;
+		}
+		if(!first)
+			newline(depth);
+		fprintf(f, "}");
+	}
+	break;
+
+	case json_t::ARRAY:
+	{
+		// scalars on one line, objects and arrays one per line
+		bool nested = false;
+		for(json_t *item : json->array)
+			nested = nested || item->type == json_t::OBJECT || item->type == json_t::ARRAY;
+		fprintf(f, "[");
+		for(size_t k = 0; k < json->array.size(); k++)
+		{
+			fprintf(f, k == 0 ? "" : (nested ? "," : ", "));
+			if(nested)
+				newline(depth + 1);
+			json_write(f, json->array[k], indent, depth + 1);
+		}
+		if(nested)
+			newline(depth);
+		fprintf(f, "]");
+	}
+	break;
+
+	case json_t::INTEGER: fprintf(f, "%lld", json->integer); break;
+	case json_t::REAL: fprintf(f, "%.17g", json->real); break;
+	case json_t::STRING: fprintf(f, "\"%s\"", json->string.c_str()); break;
+	}
+}
+
+int json_dump_file(const json_t *json, const char *path, size_t flags)
+{
+	FILE *f = fopen(path, "w");
+	if(f == NULL || json == NULL)
+	{
+		if(f != NULL)
+			fclose(f);
+		return -1;
+	}
+	json_write(f, json, flags & 0x1F, 0);
+	fprintf(f, "\n");
+	fclose(f);
+	return 0;
+}
+
+////////////////////
+// nanovg
+////////////////////
+
+NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b) { return nvgRGBA(r, g, b, 255); }
+NVGcolor nvgRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+	NVGcolor rv = {r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f};
+	return rv;
+}
+NVGcolor nvgTransRGBA(NVGcolor c, unsigned char a)
+{
+	c.a = a / 255.0f;
+	return c;
+}
+
+namespace rack {
+
+////////////////////
+// util
+////////////////////
+
+void info(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "[info] ");
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
+
+void warn(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "[warning] ");
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
+
+// both on rand(), so that srand() makes a render repeatable
+uint32_t randomu32()
+{
+	return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+float randomf()
+{
+	return rand() / (RAND_MAX + 1.0f);
+}
+
+////////////////////
+// engine
+////////////////////
+
+static float sampleRate = 44100.0;
+float engineGetSampleRate() { return sampleRate; }
+float engineGetSampleTime() { return 1.0 / sampleRate; }
+void engineSetSampleRate(float newSampleRate) { sampleRate = newSampleRate; }
+
+////////////////////
+// resources
+////////////////////
+
+// cached by path like Rack's: an asset is read again only once nothing holds it
+std::shared_ptr<SVG> SVG::load(const std::string &filename)
+{
+	static std::map<std::string, std::weak_ptr<SVG>> cache;
+	std::shared_ptr<SVG> rv = cache[filename].lock();
+	if(!rv)
+	{
+		rv = std::make_shared<SVG>();
+		rv->path = filename;
+		cache[filename] = rv;
+	}
+	return rv;
+}
+
+std::shared_ptr<Font> Font::load(const std::string &filename)
+{
+	static std::map<std::string, std::weak_ptr<Font>> cache;
+	std::shared_ptr<Font> rv = cache[filename].lock();
+	if(!rv)
+	{
+		rv = std::make_shared<Font>();
+		cache[filename] = rv;
+	}
+	return rv;
+}
+
+std::string assetGlobal(std::string filename) { return filename; }
+std::string assetPlugin(Plugin *plugin, std::string filename) { return filename; }
+std::string assetLocal(std::string filename) { return filename; }
+
+} // namespace rack
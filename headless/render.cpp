@@ -0,0 +1,164 @@
+// Offline renderer: drives a module's step() for a number of samples with
+// scripted inputs and writes every output (and optionally every light) to a file.
+#include "host.hpp"
+#include "trace.hpp"
+#include <unistd.h>
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: render [options] <model>\n"
+		"  -n <samples>  samples to render (default: one second)\n"
+		"  -r <rate>     sample rate in Hz (default: 44100)\n"
+		"  -s <script>   input script\n"
+		"  -o <file>     output file (default: stdout)\n"
+		"  -d <n>        write one sample every n (default: 1)\n"
+		"  -l            write lights too (sample by sample rendering only)\n"
+		"  -b <frames>   render through processBlock() in blocks of this size\n"
+		"  -E            no edge scheduling in processBlock()\n"
+		"  -t            write a golden trace (only the changes) instead of rows, see golden\n"
+		"  -m            list the available models\n"
+#ifdef USE_COUNTERS
+		"  -c <file>     save the hot path counters as JSON\n"
+#endif
+		);
+}
+
+// the counters of the rendered instance, when built with COUNTERS=1
+static bool save_counters(const char *filename)
+{
+#ifdef USE_COUNTERS
+	if(filename == NULL)
+		return true;
+	json_t *rootJ = SequencerWidget::countersToJson();
+	bool rv = json_dump_file(rootJ, filename, JSON_INDENT(2)) == 0;
+	json_decref(rootJ);
+	if(!rv)
+		fprintf(stderr, "cannot write %s\n", filename);
+	return rv;
+#else
+	return true;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+	long samples = -1;
+	float rate = 44100.0;
+	const char *scriptFile = NULL;
+	const char *outFile = NULL;
+	long decimation = 1;
+	bool with_lights = false;
+	bool list = false;
+	int blockSize = 0;
+	bool scheduling = true;
+	bool asTrace = false;
+	const char *countersFile = NULL;
+
+	int opt;
+	while((opt = getopt(argc, argv, "n:r:s:o:d:b:c:lmEth")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n': samples = atol(optarg); break;
+		case 'r': rate = atof(optarg); break;
+		case 's': scriptFile = optarg; break;
+		case 'o': outFile = optarg; break;
+		case 'd': decimation = std::max(1L, atol(optarg)); break;
+		case 'l': with_lights = true; break;
+		case 'b': blockSize = std::max(0, atoi(optarg)); break;
+		case 'E': scheduling = false; break;
+		case 't': asTrace = true; break;
+		case 'c': countersFile = optarg; break;
+		case 'm': list = true; break;
+		default: usage(); return 1;
+		}
+	}
+
+	Host host;
+	if(list)
+	{
+		for(Model *model : host.Models())
+			printf("%s\t%s\n", model->slug.c_str(), model->name.c_str());
+		return 0;
+	}
+
+	if(optind >= argc || rate <= 0)
+	{
+		usage();
+		return 1;
+	}
+
+	engineSetSampleRate(rate);
+	if(samples < 0)
+		samples = (long)rate;
+
+	Script script;
+	if(scriptFile != NULL && !script.Load(scriptFile))
+		return 1;
+
+	ModuleWidget *widget = host.Create(argv[optind]);
+	if(widget == NULL)
+	{
+		fprintf(stderr, "unknown model %s\n", argv[optind]);
+		return 1;
+	}
+	Module *module = widget->module;
+	module->onSampleRateChange();
+
+	BlockModule *blockModule = dynamic_cast<BlockModule *>(module);
+	if(blockModule != NULL)
+	{
+		blockModule->edgeScheduling = scheduling;
+		if(with_lights)
+			blockModule->lightDivider = 1;   // lights follow every sample
+	}
+
+	if(asTrace)
+	{
+		Trace trace;
+		trace.Begin(argv[optind], rate, module->outputs.size());
+		Render(module, script, samples, blockSize, [&](long n, const float *values) { trace.Add(n, values); });
+		bool rv = trace.Save(outFile == NULL ? "/dev/stdout" : outFile) && save_counters(countersFile);
+		delete widget;
+		return rv ? 0 : 1;
+	}
+
+	FILE *f = outFile == NULL ? stdout : fopen(outFile, "w");
+	if(f == NULL)
+	{
+		fprintf(stderr, "cannot write %s\n", outFile);
+		delete widget;
+		return 1;
+	}
+
+	fprintf(f, "# %s %g Hz %li samples, %i outputs", argv[optind], rate, samples, (int)module->outputs.size());
+	if(with_lights)
+		fprintf(f, ", %i lights", (int)module->lights.size());
+	fprintf(f, "\n");
+
+	if(blockSize > 0)
+		with_lights = false;      // lights are only up to date at the end of a block
+
+	int numOutputs = module->outputs.size();
+	Render(module, script, samples, blockSize, [&](long n, const float *values)
+	{
+		if(n % decimation != 0)
+			return;
+		fprintf(f, "%li", n);
+		for(int k = 0; k < numOutputs; k++)
+			fprintf(f, " %.9g", values[k]);
+		if(with_lights)
+		{
+			for(const Light &l : module->lights)
+				fprintf(f, " %.9g", l.value);
+		}
+		fprintf(f, "\n");
+	});
+
+	if(f != stdout)
+		fclose(f);
+	bool rv = save_counters(countersFile);
+	delete widget;
+	return rv ? 0 : 1;
+}
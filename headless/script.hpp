@@ -0,0 +1,211 @@
+#pragma once
+#include "rack.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <limits.h>
+
+using namespace rack;
+
+// Scripted input stimulus for a module, one command per line:
+//
+//   # comment
+//   param <id> <value>                 set a param before the first sample
+//   input <id> <value>                 hold an input at a constant value
+//   clock <id> <hz> [pw]               0/10V square clock, pulse width 0..1 (default 0.5)
+//   lfo <id> <hz> <min> <max>          sine modulation between min and max
+//   plfo <id> <hz> <min> <max>         same, on a param
+//   at <sample> param <id> <value>     set a param at the given sample
+//   at <sample> input <id> <value>     set an input at the given sample
+//   at <sample> pulse <id> <samples>   10V pulse on an input, e.g. a reset
+//   set <key> <value>                  integer setting saved with the patch,
+//                                      loaded through fromJson() at the start
+//
+// Every scripted input is marked as connected.
+struct Script
+{
+public:
+	bool Load(const char *filename)
+	{
+		FILE *f = fopen(filename, "r");
+		if(f == NULL)
+		{
+			warn("cannot open script %s", filename);
+			return false;
+		}
+
+		char line[256];
+		int lineNumber = 0;
+		bool rv = true;
+		while(rv && fgets(line, sizeof(line), f) != NULL)
+		{
+			lineNumber++;
+			if(!Add(line))
+			{
+				warn("%s:%i: cannot parse '%s'", filename, lineNumber, strtok(line, "\r\n"));
+				rv = false;
+			}
+		}
+		fclose(f);
+		return rv;
+	}
+
+	// add a single command; blank lines and comments are accepted
+	bool Add(const char *line)
+	{
+		const char *p = line + strspn(line, " \t");
+		if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+			return true;
+		return parse(p);
+	}
+
+	// set up the module before the first sample
+	void Begin(Module *module)
+	{
+		if(!settings.empty())
+		{
+			json_t *rootJ = json_object();
+			for(const auto &it : settings)
+				json_object_set_new(rootJ, it.first.c_str(), json_integer(it.second));
+			module->fromJson(rootJ);
+			json_decref(rootJ);
+		}
+		std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.sample < b.sample; });
+		nextEvent = 0;
+		for(const Generator &g : generators)
+		{
+			if(!g.param)
+				module->inputs[g.id].active = true;
+		}
+		for(const Event &e : events)
+		{
+			if(e.type == Event::INPUT)
+				module->inputs[e.id].active = true;
+		}
+	}
+
+	// drive the inputs for sample n; samples must be applied in order
+	void Apply(Module *module, long n)
+	{
+		while(nextEvent < events.size() && events[nextEvent].sample <= n)
+		{
+			const Event &e = events[nextEvent++];
+			if(e.type == Event::PARAM)
+				module->params[e.id].value = e.value;
+			else
+				module->inputs[e.id].value = e.value;
+		}
+
+		if(generators.empty())
+			return;
+
+		double t = n / (double)engineGetSampleRate();
+		for(const Generator &g : generators)
+		{
+			double phase = t * g.hz;
+			phase -= floor(phase);
+			float v;
+			if(g.type == Generator::CLOCK)
+				v = phase < g.a ? 10.0 : 0.0;
+			else
+				v = g.a + (g.b - g.a) * 0.5 * (1.0 - cos(2.0 * M_PI * phase));
+			if(g.param)
+				module->params[g.id].value = v;
+			else
+				module->inputs[g.id].value = v;
+		}
+	}
+
+	// first sample >= n at which a param may change, to split processing blocks there
+	long NextParamChange(long n)
+	{
+		for(const Generator &g : generators)
+		{
+			if(g.param)
+				return n;
+		}
+		for(size_t k = nextEvent; k < events.size(); k++)
+		{
+			if(events[k].type == Event::PARAM && events[k].sample >= n)
+				return events[k].sample;
+		}
+		return LONG_MAX;
+	}
+
+private:
+	struct Event
+	{
+		enum { PARAM, INPUT } type;
+		long sample;
+		int id;
+		float value;
+	};
+
+	struct Generator
+	{
+		enum { CLOCK, LFO } type;
+		bool param;
+		int id;
+		double hz;
+		double a, b;
+	};
+
+	std::vector<Event> events;
+	std::vector<Generator> generators;
+	std::vector<std::pair<std::string, long long>> settings;
+	size_t nextEvent = 0;
+
+	void addEvent(long sample, int type, int id, float value)
+	{
+		Event e;
+		e.type = (decltype(e.type))type;
+		e.sample = sample;
+		e.id = id;
+		e.value = value;
+		events.push_back(e);
+	}
+
+	bool parse(const char *line)
+	{
+		char cmd[16], what[16], key[64];
+		long long setting;
+		long sample, len;
+		int id;
+		float v;
+		double hz, a, b;
+
+		if(sscanf(line, "param %i %f", &id, &v) == 2)
+			addEvent(0, Event::PARAM, id, v);
+		else if(sscanf(line, "input %i %f", &id, &v) == 2)
+			addEvent(0, Event::INPUT, id, v);
+		else if(sscanf(line, "%15s", cmd) == 1 && !strcmp(cmd, "clock"))
+		{
+			a = 0.5;
+			if(sscanf(line, "clock %i %lf %lf", &id, &hz, &a) < 2)
+				return false;
+			generators.push_back(Generator{Generator::CLOCK, false, id, hz, a, 0});
+		} else if(sscanf(line, "lfo %i %lf %lf %lf", &id, &hz, &a, &b) == 4)
+			generators.push_back(Generator{Generator::LFO, false, id, hz, a, b});
+		else if(sscanf(line, "plfo %i %lf %lf %lf", &id, &hz, &a, &b) == 4)
+			generators.push_back(Generator{Generator::LFO, true, id, hz, a, b});
+		else if(sscanf(line, "set %63s %lli", key, &setting) == 2)
+			settings.push_back(std::make_pair(std::string(key), setting));
+		else if(sscanf(line, "at %li %15s %i %f", &sample, what, &id, &v) == 4)
+		{
+			if(!strcmp(what, "param"))
+				addEvent(sample, Event::PARAM, id, v);
+			else if(!strcmp(what, "input"))
+				addEvent(sample, Event::INPUT, id, v);
+			else if(!strcmp(what, "pulse"))
+			{
+				len = std::max(1L, (long)v);
+				addEvent(sample, Event::INPUT, id, 10.0);
+				addEvent(sample + len, Event::INPUT, id, 0.0);
+			} else
+				return false;
+		} else
+			return false;
+
+		return true;
+	}
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include "rack.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace rack;
+
+// Output trace of a render that keeps, for every output, only the samples
+// where its value changes; sequencer outputs hold for thousands of samples,
+// so the traces stay small enough to live in the repository:
+//
+//   # <model> <rate> <samples> <outputs>
+//   <sample> <output> <value>
+//
+// Values are written with 9 significant digits and read back bit-exact.
+struct Trace
+{
+public:
+	struct Change
+	{
+		long sample;
+		float value;
+	};
+
+	std::string model;
+	float rate = 0;
+	long samples = 0;
+	std::vector<std::vector<Change>> outputs;
+
+	void Begin(const char *modelSlug, float sampleRate, int numOutputs)
+	{
+		model = modelSlug;
+		rate = sampleRate;
+		samples = 0;
+		outputs.assign(numOutputs, std::vector<Change>());
+	}
+
+	// record the output values of sample n; samples must be added in order
+	void Add(long n, const float *values)
+	{
+		for(size_t k = 0; k < outputs.size(); k++)
+		{
+			if(outputs[k].empty() || !same(outputs[k].back().value, values[k]))
+				outputs[k].push_back(Change{n, values[k]});
+		}
+		samples = n + 1;
+	}
+
+	bool Save(const char *filename) const
+	{
+		FILE *f = fopen(filename, "w");
+		if(f == NULL)
+		{
+			warn("cannot write %s", filename);
+			return false;
+		}
+
+		fprintf(f, "# %s %g %li %i\n", model.c_str(), rate, samples, (int)outputs.size());
+		std::vector<size_t> pos(outputs.size(), 0);
+		for(;;)
+		{
+			// merge by sample, so the file reads in time order
+			int k = -1;
+			for(size_t i = 0; i < outputs.size(); i++)
+			{
+				if(pos[i] < outputs[i].size() && (k < 0 || outputs[i][pos[i]].sample < outputs[k][pos[k]].sample))
+					k = i;
+			}
+			if(k < 0)
+				break;
+			const Change &c = outputs[k][pos[k]++];
+			fprintf(f, "%li %i %.9g\n", c.sample, k, c.value);
+		}
+		fclose(f);
+		return true;
+	}
+
+	bool Load(const char *filename)
+	{
+		FILE *f = fopen(filename, "r");
+		if(f == NULL)
+		{
+			warn("cannot open trace %s", filename);
+			return false;
+		}
+
+		char slug[64];
+		int numOutputs;
+		bool rv = fscanf(f, "# %63s %f %li %i", slug, &rate, &samples, &numOutputs) == 4 && numOutputs >= 0;
+		if(rv)
+		{
+			model = slug;
+			outputs.assign(numOutputs, std::vector<Change>());
+			Change c;
+			int k;
+			while(rv && fscanf(f, "%li %i %f", &c.sample, &k, &c.value) == 3)
+			{
+				rv = k >= 0 && k < numOutputs;
+				if(rv)
+					outputs[k].push_back(c);
+			}
+			rv = rv && feof(f);
+		}
+		if(!rv)
+			warn("%s is not a valid trace", filename);
+		fclose(f);
+		return rv;
+	}
+
+	// first sample at which output k differs between the two traces, -1 if none
+	static long Diverge(const Trace &a, const Trace &b, int k, float *va, float *vb)
+	{
+		static const std::vector<Change> none;
+		const std::vector<Change> &ca = k < (int)a.outputs.size() ? a.outputs[k] : none;
+		const std::vector<Change> &cb = k < (int)b.outputs.size() ? b.outputs[k] : none;
+		long end = std::min(a.samples, b.samples);
+		size_t i = 0, j = 0;
+		*va = *vb = 0;
+		for(long n = 0; n < end;)
+		{
+			while(i < ca.size() && ca[i].sample <= n)
+				*va = ca[i++].value;
+			while(j < cb.size() && cb[j].sample <= n)
+				*vb = cb[j++].value;
+			if(!same(*va, *vb))
+				return n;
+
+			// both outputs hold until the next change of either
+			long next = end;
+			if(i < ca.size())
+				next = std::min(next, ca[i].sample);
+			if(j < cb.size())
+				next = std::min(next, cb[j].sample);
+			n = next;
+		}
+		return a.samples == b.samples ? -1 : end;
+	}
+
+private:
+	// bitwise, so that -0 and 0 differ and NaN matches NaN
+	static bool same(float a, float b)
+	{
+		return !memcmp(&a, &b, sizeof(float)) || (isnan(a) && isnan(b));
+	}
+};
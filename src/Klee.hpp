@@ -1,6 +1,7 @@
 #include "common.hpp"
 #include <algorithm>
 #include "dsp/digital.hpp"
+#include <atomic>
 
 struct KleeWidget : SequencerWidget
 {
@@ -10,14 +11,39 @@ private:
 		RANDOMIZE_BUS,
 		RANDOMIZE_PITCH,
 		RANDOMIZE_LOAD,
-		SET_RANGE_1V
+		SET_RANGE_1V,
+		AUDIO_RATE,
+		LENGTH_16,
+		LENGTH_32,
+		LENGTH_64,
+		EXPORT_CSV,
+		EXPORT_MIDI,
+		SUGGEST_PATTERN
 	};
+	int recalls = 0;
+	float shownSnapshot = 1;
+	void exportHistory(bool midi);
+	void suggestPattern();
+
+protected:
 	Menu *addContextMenu(Menu *menu) override;
 
 public:
 	KleeWidget();
+	void step() override;
 	void onMenu(int action);
 };
 
+// Klee with the outputs and trimpots of its voices on a 16HP strip
+struct KleePolyWidget : KleeWidget
+{
+private:
+	Menu *addContextMenu(Menu *menu) override;
+
+public:
+	KleePolyWidget();
+	void onMenu(int voices);
+};
+
 
 
@@ -1,188 +1,395 @@
 #include "Klee.hpp"
+#include "KleeModule.hpp"
 
-struct Klee : Module
-{
-	enum ParamIds
-	{
-		PITCH_KNOB,
-		GROUPBUS = PITCH_KNOB + 16,
-		LOAD_BUS = GROUPBUS + 16,
-		LOAD_PARAM = LOAD_BUS + 16,
-		STEP_PARAM,
-		X28_X16,
-		RND_PAT,
-		B_INV,
-		RND_THRESHOLD,
-		BUS1_LOAD,
-		BUS_MERGE,
-		RANGE = BUS_MERGE + 3,
-		BUS2_MODE,
-		NUM_PARAMS
-	};
+void Klee::on_loaded()
+{
+#ifdef LAUNCHPAD
+	connected = 0;
 
-	enum InputIds
-	{
-		LOAD_INPUT,
-		EXT_CLOCK_INPUT,
-		RND_THRES_IN,
-		RANGE_IN,
-		NUM_INPUTS
-	};
+#endif
+	update_bus_masks();
+	for(int k = 0; k < 16; k++)
+		pitch[k] = params[PITCH_KNOB + k].value;
+	for(int k = 0; k < 16; k++)
+		update_pitch(k);
+	load();
+}
+
+void Klee::beginBlock()
+{
+	loadParam = params[LOAD_PARAM].value;
+	stepParam = params[STEP_PARAM].value;
+	recallParam = params[RECALL_PARAM].value;
+	storeParam = params[STORE_PARAM].value;
+	if(audioRateRequest.load(std::memory_order_relaxed) >= 0)
+		apply_audio_rate();
+}
 
-	enum OutputIds
+// the bus masks and pitch sums follow the switches and knobs, checked on the clock
+void Klee::check_params()
+{
+	for(int k = 0; k < 16; k++)
 	{
-		CV_A,
-		CV_B,
-		CV_AB,
-		CV_A__B,
-		GATE_OUT,
-		TRIG_OUT = GATE_OUT + 3,
-		temp = TRIG_OUT + 3,
-		NUM_OUTPUTS
-	};
+		if(params[GROUPBUS + k].value != groupBus[k])
+		{
+			update_bus_masks();
+			break;
+		}
+	}
+	for(int k = 0; k < 16; k++)
+	{
+		if(params[PITCH_KNOB + k].value != pitch[k])
+			update_pitch(k);
+	}
+}
 
-	enum LightIds
+void Klee::process()
+{
+	sampleCount++;
+	if(audioRate)
 	{
-		LED_PITCH,
+		for(int k = 0; k < NUM_SMOOTHED; k++)
+			outputs[k].value = naive[k];
+		for(int k = VOICE_OUT; k < VOICE_OUT + 2 * numVoices; k++)
+			outputs[k].value = naive[k];
+	}
 
-		LED_BUS = LED_PITCH + 16,
-		temp1 = LED_BUS + 3,
-		NUM_LIGHTS
-	};
+	if(activeTriggers)
+		check_triggers();
 
-	Klee() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	if(loadTrigger.process(loadParam + inputs[LOAD_INPUT].value))
 	{
-#ifdef LAUNCHPAD
-		drv = new LaunchpadBindingDriver(Scene1, 1);
-#endif
-
-		on_loaded();
+		COUNT(this, resets);
+		load();
 	}
 
-#ifdef LAUNCHPAD
-	~Klee()
+	if(storeTrigger.process(storeParam))
+		store_snapshot(SelectedSnapshot());
+	if(recallTrigger.process(recallParam + inputs[RECALL_INPUT].value))
 	{
-		delete drv;
+		int slot = SelectedSnapshot();
+		if(snapshot[slot].used)
+			recallSlot = slot;
 	}
-#endif
 
-	void fromJson(json_t *root) override { Module::fromJson(root); on_loaded(); }
-	json_t *toJson() override
+	float clock = inputs[EXT_CLOCK_INPUT].value + stepParam;
+	int clk = clockTrigger.process(clock); // 1=rise, -1=fall
+	if(clk == 1)
 	{
-		json_t *rootJ = json_object();
-
-		return rootJ;
+		COUNT(this, clockEdges);
+		COUNT(this, steps);
+		if(voicesRequest.load(std::memory_order_relaxed) != 0)
+			apply_voices();
+		if(recallSlot >= 0)
+		{
+			recall_snapshot();
+		} else if(lengthRequest.load(std::memory_order_relaxed) != 0)
+		{
+			apply_length();
+		} else
+		{
+			check_params();
+			if(!replay_cycle())
+			{
+				sr_rotate();
+				update_bus();
+			}
+		}
+		populate_outputs();
+		record_history();
 	}
-	void step() override;
-	void reset() override { load(); }
-	void randomize() override { load(); }
-
-#ifdef LAUNCHPAD
-	LaunchpadBindingDriver *drv;
-	float connected;
-#endif
 
-private:
-	const float pulseTime = 0.002;      //2msec trigger
-	void showValues();
-	void sr_rotate();
-	bool chance();
-	void populate_gate(int clk);
-	void update_bus();
-	void load();
-	void on_loaded();
-	void populate_outputs();
-	void check_triggers(float deltaTime);
-	bool isSwitchOn(int ptr);
-	int getValue3(int k);
-	SchmittTrigger loadTrigger;
-	SchmittTrigger2 clockTrigger;
-	PulseGenerator triggers[3];
-
-	union
-	{
-		struct
-		{
-			bool A[8];
-			bool B[8];
-		};
-		bool P[16];
-	} shiftRegister;
+	if(clk != 0)
+	{
+		populate_gate(clk);
+		markLights();
+	}
 
-	bool bus_active[3];
-};
+	if(audioRate)
+	{
+		// fraction of a sample since the clock crossed the threshold
+		float edge = 0;
+		float span = clock - lastClock;
+		if(clk != 0 && span != 0)
+			edge = clampf((clock - (clk == 1 ? clockTrigger.high : clockTrigger.low)) / span, 0.0, 1.0);
+		lastClock = clock;
+		smooth_outputs(0, NUM_SMOOTHED, edge);
+		smooth_outputs(VOICE_OUT, VOICE_OUT + 2 * numVoices, edge);
+	}
+}
 
-void Klee::on_loaded()
+// the smoothing starts over from the outputs as they are
+void Klee::apply_audio_rate()
 {
-#ifdef LAUNCHPAD
-	connected = 0;
-
-#endif
-	load();
+	for(int k = 0; k < NUM_OUTPUTS; k++)
+		naive[k] = pending[k] = outputs[k].value;
+	lastClock = inputs[EXT_CLOCK_INPUT].value + stepParam;
+	audioRate = audioRateRequest.exchange(-1) != 0;
 }
 
-void Klee::step()
+// Each step of an output is spread over the sample before the edge and the
+// one after it (polyBLEP), so the outputs are one sample late.
+void Klee::smooth_outputs(int from, int to, float edge)
 {
-	float deltaTime = 1.0 / engineGetSampleRate();
-
-	if(loadTrigger.process(params[LOAD_PARAM].value + inputs[LOAD_INPUT].value))
+	for(int k = from; k < to; k++)
 	{
-		load();
+		float v = outputs[k].value;
+		float out = pending[k];
+		pending[k] = v;
+		if(v != naive[k])
+		{
+			float h = 0.5f * (v - naive[k]);
+			out += h * edge * edge;
+			pending[k] -= h * (1 - edge) * (1 - edge);
+			naive[k] = v;
+		}
+		outputs[k].value = out;
 	}
+}
 
-	int clk = clockTrigger.process(inputs[EXT_CLOCK_INPUT].value + params[STEP_PARAM].value); // 1=rise, -1=fall
-	if(clk == 1)
+int Klee::nextEvent(const float *const *in, int n, int frames)
+{
+	const float *clock = buffer(in, EXT_CLOCK_INPUT);
+	if(audioRate)
 	{
-		sr_rotate();
-		update_bus();
-		populate_outputs();
+		// a step still going out
+		for(int k = 0; k < NUM_SMOOTHED; k++)
+		{
+			if(pending[k] != outputs[k].value)
+				return n;
+		}
+		for(int k = VOICE_OUT; k < VOICE_OUT + 2 * numVoices; k++)
+		{
+			if(pending[k] != outputs[k].value)
+				return n;
+		}
 	}
 
-	if(clk != 0)
+	// a running trigger only needs the sample where it ends
+	int limit = frames;
+	for(int k = 0; k < 3; k++)
 	{
-		populate_gate(clk);
+		if(triggerCount[k] > 0)
+			limit = std::min(limit, n - 1 + triggerCount[k]);
 	}
 
-	check_triggers(deltaTime);
-
-	showValues();
+	int next = nextEdge(clockTrigger, clock, inputs[EXT_CLOCK_INPUT].value, stepParam, n, limit);
+	next = nextEdge(loadTrigger, buffer(in, LOAD_INPUT), inputs[LOAD_INPUT].value, loadParam, n, next);
+	next = nextEdge(recallTrigger, buffer(in, RECALL_INPUT), inputs[RECALL_INPUT].value, recallParam, n, next);
+	next = nextEdge(storeTrigger, NULL, 0, storeParam, n, next);
+	if(activeTriggers)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			if(triggerCount[k] > 0)
+				triggerCount[k] -= next - n;  // the skipped samples
+		}
+	}
+	sampleCount += next - n;
+	if(audioRate && clock != NULL && next > n)
+		lastClock = clock[next - 1] + stepParam;   // the sample before the next one processed
+	return next;
+}
 
+void Klee::endBlock()
+{
 #ifdef LAUNCHPAD
 	connected = drv->Connected() ? 1.0 : 0.0;
 	drv->ProcessLaunchpad();
+	COUNT_LAUNCHPAD(this, drv);
 #endif
 }
 
-void Klee::load()
+uint64_t Klee::load_pattern()
 {
+	uint16_t bits = 0;
 	for(int k = 0; k < 16; k++)
 	{
-		shiftRegister.P[k] = isSwitchOn(LOAD_BUS + k);
+		if(isSwitchOn(LOAD_BUS + k))
+			bits |= 1 << k;
 	}
+	return page(bits);
+}
+
+void Klee::set_length(int n)
+{
+	length = valid_length(n);
+	int half = length / 2;
+	lengthMask = length == 64 ? ~0ULL : (1ULL << length) - 1;
+	feedbackMask = 1ULL | (1ULL << half);
+	splitMask = lengthMask & ~feedbackMask;
+	bankRepeat = 0;
+	for(int k = 0; k < half; k += 8)
+		bankRepeat |= 1ULL << k;
+}
+
+// the 16 controls of the panel, A in the low byte, over all the stages of the register
+uint64_t Klee::page(uint16_t bits)
+{
+	return (bits & 0xFF) * bankRepeat | ((bits >> 8) * bankRepeat) << (length / 2);
+}
+
+// n < length
+uint64_t Klee::rotate_left(uint64_t reg, int n)
+{
+	if(n == 0)
+		return reg;
+	return ((reg << n) | (reg >> (length - n))) & lengthMask;
 }
 
+// the switches the cycle depends on, -1 when there is no cycle
+int Klee::cycle_mode()
+{
+	if(isSwitchOn(RND_PAT) || isSwitchOn(BUS1_LOAD))
+		return -1;
+	return isSwitchOn(X28_X16) | (isSwitchOn(B_INV) << 1) | (isSwitchOn(BUS2_MODE) << 2);
+}
+
+bool Klee::replay_cycle()
+{
+	int mode = cycle_mode();
+	if(mode < 0)
+	{
+		cycleValid = false;
+		return false;
+	}
+	if((!cycleValid || mode != cycleMode) && !build_cycle(mode))
+		return false;
+
+	for(int v = 0; v < numVoices; v++)
+	{
+		int pos = cyclePos[v] + 1;
+		if(pos == cycleLength[v])
+			pos = 0;
+		cyclePos[v] = pos;
+		shiftRegister[v] = cycle[v][pos].reg;
+		bus_active[v] = cycle[v][pos].bus;
+	}
+	return true;
+}
+
+// the states from the current one on, until the register comes back to it;
+// false if it does not within 64 steps
+bool Klee::build_cycle(int mode)
+{
+	bool x28 = mode & 1;
+	uint64_t inv = (mode & 2) ? 1ULL << (length / 2) : 0;
+	bool and2 = mode & 4;
+	for(int v = 0; v < numVoices; v++)
+	{
+		uint64_t reg = shiftRegister[v];
+		int n = 0;
+		do
+		{
+			if(n == 64)
+			{
+				cycleValid = false;
+				return false;
+			}
+			cycle[v][n].reg = reg;
+			cycle[v][n].bus = bus_of(reg, and2);
+			reg = rotate(reg, x28, inv);
+			n++;
+		} while(reg != shiftRegister[v]);
+		cycleLength[v] = n;
+		cyclePos[v] = 0;
+	}
+	cycleMode = mode;
+	cycleValid = true;
+	return true;
+}
+
+void Klee::load()
+{
+	uint64_t reg = load_pattern();
+	for(int v = 0; v < MAX_VOICES; v++)
+		shiftRegister[v] = rotate_left(reg, voice_offset(v));
+	cycleValid = false;
+	markLights();
+}
+
+void Klee::load_voice(int v)
+{
+	shiftRegister[v] = rotate_left(load_pattern(), voice_offset(v));
+	cycleValid = false;
+	if(v == 0)
+		markLights();
+}
 
 void Klee::update_bus()
 {
-	bool bus1 = bus_active[0];
-	for(int k = 0; k < 3; k++)
-		bus_active[k] = false;
+	bool and2 = isSwitchOn(BUS2_MODE);
+	uint16_t risen = 0;   // voices whose bus 1 went active
+	for(int v = 0; v < numVoices; v++)
+	{
+		uint8_t active = bus_of(shiftRegister[v], and2);
+		risen |= (active & ~bus_active[v] & 1) << v;
+		bus_active[v] = active;
+	}
 
-	for(int k = 0; k < 16; k++)
+	//bus1 load
+	if(isSwitchOn(BUS1_LOAD))
 	{
-		if(shiftRegister.P[k])
+		for(int v = 0; v < numVoices; v++)
 		{
-			bus_active[getValue3(k)] = true;
+			if(risen & (1 << v))
+				load_voice(v);
 		}
 	}
-	if(isSwitchOn(BUS2_MODE))
-		bus_active[1] = bus_active[0] && bus_active[2];
+}
+
+uint8_t Klee::bus_of(uint64_t reg, bool and2)
+{
+	uint8_t bus0 = (reg & busMask[0]) != 0;
+	uint8_t bus1 = (reg & busMask[1]) != 0;
+	uint8_t bus2 = (reg & busMask[2]) != 0;
+	if(and2)
+		bus1 = bus0 & bus2;
 	else
-		bus_active[1] &= !(bus_active[0] || bus_active[2]);  //BUS 2: NOR 0 , 3
+		bus1 &= !(bus0 | bus2);  //BUS 2: NOR 0 , 3
+	return bus0 | (bus1 << 1) | (bus2 << 2);
+}
 
-	//bus1 load
-	if(isSwitchOn(BUS1_LOAD) && !bus1 && bus_active[0])
-		load();
+void Klee::update_bus_masks()
+{
+	cycleValid = false;
+	uint16_t bits[3] = {0, 0, 0};
+	for(int k = 0; k < 16; k++)
+	{
+		groupBus[k] = params[GROUPBUS + k].value;
+		bits[getValue3(k)] |= 1 << k;
+	}
+	for(int k = 0; k < 3; k++)
+		busMask[k] = page(bits[k]);
+}
+
+// sum of the pitch knobs of the stages of a bank that are on, a byte at a time
+float Klee::bank_sum(uint64_t reg, int bank)
+{
+	const float *sum = pitchSum[bank];
+	uint64_t bits = reg >> (bank * length / 2);
+	float rv = sum[bits & 0xFF];
+	for(int k = 8; k < length / 2; k += 8)
+		rv += sum[(bits >> k) & 0xFF];
+	return rv;
+}
+
+// Rebuilds the sums that include knob k. Each sum adds its highest stage
+// to the sum without it, so the entries come out the same whatever the
+// order the knobs moved in.
+void Klee::update_pitch(int k)
+{
+	pitch[k] = params[PITCH_KNOB + k].value;
+	float *sum = pitchSum[k / 8];
+	int bit = 1 << (k % 8);
+	sum[0] = 0;
+	for(int n = bit; n < 256; n = (n + 1) | bit)
+	{
+		int high = 7;
+		while(!(n & (1 << high)))
+			high--;
+		sum[n] = sum[n & ~(1 << high)] + pitch[(k & 8) + high];
+	}
 }
 
 int Klee::getValue3(int k)
@@ -197,15 +404,153 @@ bool Klee::isSwitchOn(int ptr)
 	return params[ptr].value >= 0.5;
 }
 
-void Klee::check_triggers(float deltaTime)
+// a trigger is on for triggerSamples samples from the clock edge
+void Klee::check_triggers()
 {
 	for(int k = 0; k < 3; k++)
 	{
-		if(outputs[TRIG_OUT + k].value > 0.5 && !triggers[k].process(deltaTime))
+		if(triggerCount[k] > 0 && --triggerCount[k] == 0)
 		{
 			outputs[TRIG_OUT + k].value = LVL_OFF;
+			activeTriggers &= ~(1 << k);
+		}
+	}
+}
+
+void Klee::store_snapshot(int slot)
+{
+	Snapshot &snap = snapshot[slot];
+	snap.length = length;
+	for(int v = 0; v < MAX_VOICES; v++)
+		snap.reg[v] = shiftRegister[v];
+	for(int k = 0; k < 16; k++)
+	{
+		snap.bus[k] = params[GROUPBUS + k].value;
+		snap.pitch[k] = params[PITCH_KNOB + k].value;
+	}
+	snap.used = true;
+}
+
+// the switches and knobs are set to the stored ones, until they are moved again
+void Klee::recall_snapshot()
+{
+	const Snapshot &snap = snapshot[recallSlot];
+	recallSlot = -1;
+	for(int k = 0; k < 16; k++)
+	{
+		params[GROUPBUS + k].value = snap.bus[k];
+		params[PITCH_KNOB + k].value = snap.pitch[k];
+	}
+	if(snap.length != length)
+	{
+		set_length(snap.length);
+		update_bus_masks();
+	}
+	check_params();
+
+	bool and2 = isSwitchOn(BUS2_MODE);
+	for(int v = 0; v < MAX_VOICES; v++)
+		shiftRegister[v] = snap.reg[v];
+	for(int v = 0; v < numVoices; v++)
+		bus_active[v] = bus_of(shiftRegister[v], and2);
+	cycleValid = false;
+	recalls++;
+}
+
+// a length set from the UI, on the clock: the register starts over from the load pattern
+void Klee::apply_length()
+{
+	set_length(lengthRequest.exchange(0));
+	update_bus_masks();
+	check_params();
+	load();
+
+	bool and2 = isSwitchOn(BUS2_MODE);
+	for(int v = 0; v < numVoices; v++)
+		bus_active[v] = bus_of(shiftRegister[v], and2);
+}
+
+// a voice count set from the UI, on the clock: the new voices start from the load pattern
+void Klee::apply_voices()
+{
+	int n = voicesRequest.exchange(0);
+	for(int v = numVoices; v < n; v++)
+		load_voice(v);
+	for(int k = VOICE_OUT + 2 * n; k < NUM_OUTPUTS; k++)
+		naive[k] = pending[k] = outputs[k].value = 0;
+	numVoices = n;
+	cycleValid = false;
+}
+
+json_t *Klee::snapshotsToJson()
+{
+	json_t *snapshotsJ = json_array();
+	for(int k = 0; k < NUM_SNAPSHOTS; k++)
+	{
+		const Snapshot &snap = snapshot[k];
+		if(!snap.used)
+			continue;
+		json_t *snapJ = json_object();
+		json_object_set_new(snapJ, "slot", json_integer(k));
+		json_object_set_new(snapJ, "length", json_integer(snap.length));
+		json_t *regJ = json_array();
+		for(int v = 0; v < MAX_VOICES; v++)
+			json_array_append_new(regJ, json_integer((long long)snap.reg[v]));
+		json_object_set_new(snapJ, "reg", regJ);
+		json_t *busJ = json_array();
+		json_t *pitchJ = json_array();
+		for(int n = 0; n < 16; n++)
+		{
+			json_array_append_new(busJ, json_real(snap.bus[n]));
+			json_array_append_new(pitchJ, json_real(snap.pitch[n]));
 		}
+		json_object_set_new(snapJ, "bus", busJ);
+		json_object_set_new(snapJ, "pitch", pitchJ);
+		json_array_append_new(snapshotsJ, snapJ);
 	}
+	return snapshotsJ;
+}
+
+void Klee::snapshotsFromJson(json_t *snapshotsJ)
+{
+	recallSlot = -1;
+	for(int k = 0; k < NUM_SNAPSHOTS; k++)
+		snapshot[k].used = false;
+	for(int k = 0; k < (int)json_array_size(snapshotsJ); k++)
+	{
+		json_t *snapJ = json_array_get(snapshotsJ, k);
+		int slot = json_integer_value(json_object_get(snapJ, "slot"));
+		if(slot < 0 || slot >= NUM_SNAPSHOTS)
+			continue;
+		Snapshot &snap = snapshot[slot];
+		int n = json_integer_value(json_object_get(snapJ, "length"));
+		snap.length = n >= 64 ? 64 : (n >= 32 ? 32 : 16);
+		uint64_t mask = snap.length == 64 ? ~0ULL : (1ULL << snap.length) - 1;
+		json_t *regJ = json_object_get(snapJ, "reg");
+		for(int v = 0; v < MAX_VOICES; v++)
+			snap.reg[v] = (uint64_t)json_integer_value(json_array_get(regJ, v)) & mask;
+		json_t *busJ = json_object_get(snapJ, "bus");
+		json_t *pitchJ = json_object_get(snapJ, "pitch");
+		for(int n = 0; n < 16; n++)
+		{
+			snap.bus[n] = json_number_value(json_array_get(busJ, n));
+			snap.pitch[n] = json_number_value(json_array_get(pitchJ, n));
+		}
+		snap.used = true;
+	}
+}
+
+void Klee::record_history()
+{
+	uint32_t head = historyHead.load(std::memory_order_relaxed);
+	HistoryEntry &entry = history[head % HISTORY_SIZE];
+	entry.time = sampleCount;
+	entry.reg = shiftRegister[0];
+	entry.length = length;
+	entry.bus = bus_active[0];
+	for(int k = 0; k < 4; k++)
+		entry.cv[k] = outputs[CV_A + k].value;
+	historyHead.store(head + 1, std::memory_order_release);
 }
 
 void Klee::populate_gate(int clk)
@@ -215,93 +560,193 @@ void Klee::populate_gate(int clk)
 		// gate
 		if(clk == 1)  // rise
 		{
-			outputs[GATE_OUT + k].value = bus_active[k] ? LVL_ON : LVL_OFF;
+			outputs[GATE_OUT + k].value = bus(k) ? LVL_ON : LVL_OFF;
 		} else // fall
 		{
-			if(!bus_active[k] || !isSwitchOn(BUS_MERGE + k))
+			if(!bus(k) || !isSwitchOn(BUS_MERGE + k))
 				outputs[GATE_OUT + k].value = LVL_OFF;
 		}
 	}
+
+	bool merge = isSwitchOn(BUS_MERGE);
+	for(int v = 0; v < numVoices; v++)
+	{
+		float &gate = outputs[VOICE_OUT + 2 * v + 1].value;
+		if(clk == 1)
+			gate = (bus_active[v] & 1) ? LVL_ON : LVL_OFF;
+		else if(!(bus_active[v] & 1) || !merge)
+			gate = LVL_OFF;
+	}
 }
 
 void Klee::populate_outputs()
 {
 	for(int k = 0; k < 3; k++)
 	{
-		if(bus_active[k])
+		if(bus(k))
 		{
 			outputs[TRIG_OUT + k].value = LVL_ON;
-			triggers[k].trigger(pulseTime);
+			triggerCount[k] = triggerSamples;
+			activeTriggers |= 1 << k;
 		}
 	}
 
-	float a = 0, b = 0;
 	float mult = params[RANGE].value + inputs[RANGE_IN].value;
-
-	for(int k = 0; k < 8; k++)
-	{
-		if(shiftRegister.A[k])
-			a += params[PITCH_KNOB + k].value*mult;
-
-		if(shiftRegister.B[k])
-			b += params[PITCH_KNOB + k + 8].value*mult;
-	}
+	float a = bank_sum(shiftRegister[0], 0) * mult;
+	float b = bank_sum(shiftRegister[0], 1) * mult;
 	outputs[CV_A].value = a;
 	outputs[CV_B].value = b;
 	outputs[CV_AB].value = a + b;
 	outputs[CV_A__B].value = a - b;
+
+	for(int v = 0; v < numVoices; v++)
+	{
+		uint64_t reg = shiftRegister[v];
+		outputs[VOICE_OUT + 2 * v].value = bank_sum(reg, 0) * mult + bank_sum(reg, 1) * mult;
+	}
 }
 
-void Klee::showValues()
+void Klee::updateLights()
 {
+	// a knob is lit when any of its stages is on
+	uint64_t a = shiftRegister[0] & (lengthMask >> (length / 2));
+	uint64_t b = shiftRegister[0] >> (length / 2);
+	for(int k = length / 4; k >= 8; k /= 2)
+	{
+		a |= a >> k;
+		b |= b >> k;
+	}
+	uint16_t on = (a & 0xFF) | (b & 0xFF) << 8;
 	for(int k = 0; k < 16; k++)
 	{
-		lights[LED_PITCH + k].value = shiftRegister.P[k] ? 1.0 : 0;
+		lights[LED_PITCH + k].value = ((on >> k) & 1) ? 1.0 : 0;
 	}
 
 	for(int k = 0; k < 3; k++)
 	{
 		lights[LED_BUS + k].value = outputs[GATE_OUT + k].value;
 	}
+	COUNT_N(this, lightWrites, 16 + 3);
 }
 
+// all the voices at once: the loops are branch free, for the compiler to vectorize
 void Klee::sr_rotate()
 {
-	if(!isSwitchOn(X28_X16))  // mode 1 x 16
+	bool x28 = isSwitchOn(X28_X16);
+	uint64_t inv = isSwitchOn(B_INV) ? 1ULL << (length / 2) : 0;
+	for(int v = 0; v < numVoices; v++)
+		shiftRegister[v] = rotate(shiftRegister[v], x28, inv);
+
+	if(isSwitchOn(RND_PAT))
+	{
+		for(int v = 0; v < numVoices; v++)
+			shiftRegister[v] = (shiftRegister[v] & ~1ULL) | chance(v);
+	}
+}
+
+// 1x: the whole register; 2x: both halves, without the carry from A into B,
+// the feedback of B inverted by inv
+uint64_t Klee::rotate(uint64_t reg, bool x28, uint64_t inv)
+{
+	if(!x28)
+		return ((reg << 1) | (reg >> (length - 1))) & lengthMask;
+	return (((reg << 1) & splitMask) | ((reg >> (length / 2 - 1)) & feedbackMask)) ^ inv;
+}
+
+bool Klee::chance(int v)
+{
+	return rng.Uniform() < params[RND_THRESHOLD].value + inputs[RND_THRES_IN].value + params[VOICE_THRESHOLD + v].value;
+}
+
+// The register over the last steps, a column per clock with the newest on
+// the right: the stages of A in red, B in green, the buses in blue below.
+// It is drawn into a framebuffer, rebuilt when a clock has come in.
+struct KleeHistoryView : FramebufferWidget
+{
+public:
+	static const int STEPS = 48;
+
+	KleeHistoryView(Klee *module)
+	{
+		this->module = module;
+		face = new Face();
+		face->view = this;
+		addChild(face);
+	}
+
+	void step() override
 	{
-		int fl = shiftRegister.P[15];
-		for(int k = 15; k > 0; k--)
+		uint32_t count = module->HistoryCount();
+		if(count != shown || face->box.size.x != box.size.x || face->box.size.y != box.size.y)
 		{
-			shiftRegister.P[k] = shiftRegister.P[k - 1];
+			shown = count;
+			numSteps = module->ReadHistory(steps, STEPS);
+			face->box.size = box.size;
+			dirty = true;
 		}
-		if(isSwitchOn(RND_PAT))
-			shiftRegister.P[0] = chance();
-		else
-			shiftRegister.P[0] = fl;
-	} else
-	{
-		int fla = shiftRegister.A[7];
-		int flb = shiftRegister.B[7];
-		for(int k = 7; k > 0; k--)
-		{
-			shiftRegister.A[k] = shiftRegister.A[k - 1];
-			shiftRegister.B[k] = shiftRegister.B[k - 1];
+		FramebufferWidget::step();
+	}
+
+private:
+	struct Face : TransparentWidget
+	{
+		KleeHistoryView *view;
+		void draw(NVGcontext *vg) override { view->drawHistory(vg); }
+	};
+
+	void drawHistory(NVGcontext *vg)
+	{
+		nvgBeginPath(vg);
+		nvgRoundedRect(vg, 0.0, 0.0, box.size.x, box.size.y, 4.0);
+		nvgFillColor(vg, nvgRGB(0x20, 0x20, 0x20));
+		nvgFill(vg);
+
+		float w = (box.size.x - 4) / STEPS;
+		float busHeight = 3;
+		float h = box.size.y - 4 - 3 * busHeight;
+		int x0 = STEPS - numSteps;
+		NVGcolor colors[3] = {COLOR_RED, COLOR_GREEN, COLOR_BLUE};
+		for(int c = 0; c < 3; c++)
+		{
+			nvgBeginPath(vg);
+			for(int n = 0; n < numSteps; n++)
+			{
+				const Klee::HistoryEntry &entry = steps[n];
+				float x = 2 + (x0 + n) * w;
+				if(c < 2)
+				{
+					// a row per stage of the bank, the first one at the top
+					int half = entry.length / 2;
+					float rowHeight = h / entry.length;
+					for(int k = 0; k < half; k++)
+					{
+						if((entry.reg >> (c * half + k)) & 1)
+							nvgRect(vg, x, 2 + (c * half + k) * rowHeight, w - 0.5, rowHeight - 0.5);
+					}
+				} else
+				{
+					for(int k = 0; k < 3; k++)
+					{
+						if((entry.bus >> k) & 1)
+							nvgRect(vg, x, 2 + h + k * busHeight, w - 0.5, busHeight - 0.5);
+					}
+				}
+			}
+			nvgFillColor(vg, colors[c]);
+			nvgFill(vg);
 		}
-		if(isSwitchOn(RND_PAT))
-			shiftRegister.A[0] = chance();
-		else
-			shiftRegister.A[0] = fla;
-		shiftRegister.B[0] = isSwitchOn(B_INV) ? !flb : flb;
 	}
-}
 
-bool Klee::chance()
-{
-	return rand() <= (params[RND_THRESHOLD].value + inputs[RND_THRES_IN].value) * RAND_MAX;
-}
+	Klee *module;
+	Face *face;
+	uint32_t shown = 0;
+	int numSteps = 0;
+	Klee::HistoryEntry steps[STEPS];
+};
 
 KleeWidget::KleeWidget()
 {
+	LoadTimer timer("Klee instance");
 	Klee *module = new Klee();
 	setModule(module);
 #ifdef LAUNCHPAD
@@ -464,6 +909,33 @@ KleeWidget::KleeWidget()
 	addParam(createParam<Davies1900hBlackKnob>(Vec(535, RACK_GRID_HEIGHT - 276 - 28), module, Klee::RND_THRESHOLD, 0.0, 1.0, 0.0));     // rnd threshold
 	addInput(createInput<PJ301MPort>(Vec(584, RACK_GRID_HEIGHT - 270 - 28), module, Klee::RND_THRES_IN));
 
+	KleeHistoryView *history = new KleeHistoryView(module);
+	history->box.pos = Vec(254, RACK_GRID_HEIGHT - 264);
+	history->box.size = Vec(140, 34);
+	addChild(history);
+
+	// snapshots
+	SigDisplayWidget *display = new SigDisplayWidget(2);
+	display->box.pos = Vec(188, RACK_GRID_HEIGHT - 240);
+	display->box.size = Vec(30, 20);
+	display->value = &shownSnapshot;
+	addChild(display);
+	addParam(createParam<BefacoSnappedTinyKnob>(Vec(222, RACK_GRID_HEIGHT - 243), module, Klee::SNAPSHOT, 0.0, Klee::NUM_SNAPSHOTS - 1, 0.0));
+	pwdg = createParam<BefacoPush>(Vec(192, RACK_GRID_HEIGHT - 207), module, Klee::STORE_PARAM, 0.0, 1.0, 0.0);
+	addParam(pwdg);
+#ifdef LAUNCHPAD
+	mom = new LaunchpadMomentary(ALL_LAUNCHPADS, launchpadDriver::ALL_PAGES, LaunchpadKey::PAN, LaunchpadLed::Color(5), LaunchpadLed::Color(6));
+	module->drv->Add(mom, pwdg);
+#endif
+	addInput(createInput<PJ301MPort>(Vec(223, RACK_GRID_HEIGHT - 208), module, Klee::SNAPSHOT_INPUT));
+	pwdg = createParam<BefacoPush>(Vec(404, RACK_GRID_HEIGHT - 207), module, Klee::RECALL_PARAM, 0.0, 1.0, 0.0);
+	addParam(pwdg);
+#ifdef LAUNCHPAD
+	mom = new LaunchpadMomentary(ALL_LAUNCHPADS, launchpadDriver::ALL_PAGES, LaunchpadKey::VOLUME, LaunchpadLed::Color(1), LaunchpadLed::Color(2));
+	module->drv->Add(mom, pwdg);
+#endif
+	addInput(createInput<PJ301YPort>(Vec(434, RACK_GRID_HEIGHT - 208), module, Klee::RECALL_INPUT));
+
 	// pitch Knobs + leds
 	int pos_x[8] = {109, 143, 202, 270, 336, 401, 461, 496};
 	int pos_y[8] = {232, 272, 299, 307, 307, 299, 272, 232};
@@ -504,6 +976,32 @@ KleeWidget::KleeWidget()
 #ifdef LAUNCHPAD
 	addChild(new DigitalLed((box.size.x - 28) / 2 - 32, RACK_GRID_HEIGHT - 40, &module->connected));
 #endif
+
+	build_param_index();
+}
+
+// the selected slot is shown from 1; a recall sets the bus switches and the pitch knobs from the audio thread
+void KleeWidget::step()
+{
+	Klee *klee = (Klee *)module;
+	shownSnapshot = klee->SelectedSnapshot() + 1;
+	if(klee->Recalls() != recalls)
+	{
+		recalls = klee->Recalls();
+		auto follow = [&](int first, int last)
+		{
+			for(int k = first; k < last; k++)
+			{
+				ParamWidget *pwdg = getParam(k);
+				if(pwdg != NULL && pwdg->value != module->params[k].value)
+					pwdg->setValue(module->params[k].value);
+			}
+		};
+		// a recall sets the knobs and bus switches, an old patch the voices
+		follow(Klee::PITCH_KNOB, Klee::LOAD_BUS);
+		follow(Klee::VOICE_OFFSET, Klee::NUM_PARAMS);
+	}
+	SequencerWidget::step();
 }
 
 Menu *KleeWidget::addContextMenu(Menu *menu)
@@ -512,6 +1010,19 @@ Menu *KleeWidget::addContextMenu(Menu *menu)
 	menu->addChild(new SeqMenuItem<KleeWidget>("Randomize Pitch", this, RANDOMIZE_PITCH));
 	menu->addChild(new SeqMenuItem<KleeWidget>("Randomize Bus", this, RANDOMIZE_BUS));
 	menu->addChild(new SeqMenuItem<KleeWidget>("Randomize Load", this, RANDOMIZE_LOAD));
+	SeqMenuItem<KleeWidget> *item = new SeqMenuItem<KleeWidget>("Audio Rate Clock", this, AUDIO_RATE);
+	item->rightText = ((Klee *)module)->AudioRate() ? "\u2714" : "";
+	menu->addChild(item);
+	int length = ((Klee *)module)->Length();
+	for(int k = 0; k < 3; k++)
+	{
+		item = new SeqMenuItem<KleeWidget>(("Length: " + std::to_string(16 << k)).c_str(), this, LENGTH_16 + k);
+		item->rightText = length == 16 << k ? "\u2714" : "";
+		menu->addChild(item);
+	}
+	menu->addChild(new SeqMenuItem<KleeWidget>("Export History as CSV", this, EXPORT_CSV));
+	menu->addChild(new SeqMenuItem<KleeWidget>("Export History as MIDI", this, EXPORT_MIDI));
+	menu->addChild(new SeqMenuItem<KleeWidget>("Suggest Load Pattern", this, SUGGEST_PATTERN));
 	return menu;
 }
 
@@ -522,12 +1033,230 @@ void KleeWidget::onMenu(int action)
 	case RANDOMIZE_BUS: std_randomize(Klee::GROUPBUS, Klee::GROUPBUS+16); break;
 	case RANDOMIZE_PITCH: std_randomize(Klee::PITCH_KNOB, Klee::PITCH_KNOB+16); break;
 	case RANDOMIZE_LOAD: std_randomize(Klee::LOAD_BUS, Klee::LOAD_BUS+16); break;
+	case AUDIO_RATE:
+	{
+		Klee *klee = (Klee *)module;
+		klee->setAudioRate(!klee->AudioRate());
+	}
+	break;
+	case LENGTH_16:
+	case LENGTH_32:
+	case LENGTH_64:
+		((Klee *)module)->setLength(16 << (action - LENGTH_16));
+		break;
+	case EXPORT_CSV: exportHistory(false); break;
+	case EXPORT_MIDI: exportHistory(true); break;
+	case SUGGEST_PATTERN: suggestPattern(); break;
 	case SET_RANGE_1V:
 	{
-		int index = getParamIndex(Klee::RANGE);
-		if(index >= 0)
-			params[index]->setValue(1.0);
+		ParamWidget *pwdg = getParam(Klee::RANGE);
+		if(pwdg != NULL)
+			pwdg->setValue(1.0);
 	}
 	break;
 	}
 }
+
+// MIDI: a note per step on the channel of each active bus, pitched by CV
+// A+B at 1V/oct from middle C and held to the next step; 960 ticks a second
+static void writeVarLen(std::vector<uint8_t> &track, uint32_t v)
+{
+	uint8_t bytes[5];
+	int n = 0;
+	do
+	{
+		bytes[n++] = v & 0x7F;
+		v >>= 7;
+	} while(v != 0);
+	while(n > 1)
+		track.push_back(bytes[--n] | 0x80);
+	track.push_back(bytes[0]);
+}
+
+static bool writeMidiHistory(FILE *f, const Klee::HistoryEntry *steps, int n, float sampleRate)
+{
+	const int ticksPerSecond = 960;    // 480 per quarter at 120 BPM
+	std::vector<uint8_t> track = {0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20};   // tempo 500000us
+	uint32_t lastTick = 0;
+	int notes[3] = {-1, -1, -1};
+	// the last step lasts as long as the one before
+	uint32_t end = steps[n - 1].time + (n > 1 ? steps[n - 1].time - steps[n - 2].time : 0);
+	for(int k = 0; k <= n; k++)
+	{
+		uint32_t samples = (k < n ? steps[k].time : end) - steps[0].time;
+		uint32_t tick = (uint32_t)roundf(samples * (float)ticksPerSecond / sampleRate);
+		for(int c = 0; c < 3; c++)
+		{
+			if(notes[c] < 0)
+				continue;
+			writeVarLen(track, tick - lastTick);
+			lastTick = tick;
+			track.insert(track.end(), {(uint8_t)(0x80 | c), (uint8_t)notes[c], 0x40});
+			notes[c] = -1;
+		}
+		if(k == n)
+			break;
+		int note = (int)roundf(60 + 12 * steps[k].cv[2]);
+		note = std::max(0, std::min(note, 127));
+		for(int c = 0; c < 3; c++)
+		{
+			if(!((steps[k].bus >> c) & 1))
+				continue;
+			writeVarLen(track, tick - lastTick);
+			lastTick = tick;
+			track.insert(track.end(), {(uint8_t)(0x90 | c), (uint8_t)note, 0x64});
+			notes[c] = note;
+		}
+	}
+	track.insert(track.end(), {0x00, 0xFF, 0x2F, 0x00});
+
+	uint32_t size = track.size();
+	const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0x01, 0xE0,
+		'M', 'T', 'r', 'k', (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size};
+	return fwrite(header, sizeof(header), 1, f) == 1 && fwrite(track.data(), size, 1, f) == 1;
+}
+
+// the whole history, from the oldest step, to TheXOR-Klee-history.csv or .mid
+void KleeWidget::exportHistory(bool midi)
+{
+	std::vector<Klee::HistoryEntry> steps(Klee::HISTORY_SIZE);
+	int n = ((Klee *)module)->ReadHistory(steps.data(), Klee::HISTORY_SIZE);
+	std::string path = assetLocal(midi ? "TheXOR-Klee-history.mid" : "TheXOR-Klee-history.csv");
+	if(n == 0)
+	{
+		warn("no Klee history to export");
+		return;
+	}
+
+	FILE *f = fopen(path.c_str(), midi ? "wb" : "w");
+	bool ok = f != NULL;
+	if(ok && midi)
+	{
+		ok = writeMidiHistory(f, steps.data(), n, engineGetSampleRate());
+	} else if(ok)
+	{
+		fprintf(f, "time,register,length,bus1,bus2,bus3,cv_a,cv_b,cv_ab,cv_a_b\n");
+		for(int k = 0; k < n; k++)
+		{
+			const Klee::HistoryEntry &entry = steps[k];
+			fprintf(f, "%.6f,%016llx,%i,%i,%i,%i,%g,%g,%g,%g\n", (entry.time - steps[0].time) / engineGetSampleRate(),
+				(unsigned long long)entry.reg, entry.length, entry.bus & 1, (entry.bus >> 1) & 1, (entry.bus >> 2) & 1,
+				entry.cv[0], entry.cv[1], entry.cv[2], entry.cv[3]);
+		}
+		ok = !ferror(f);
+	}
+	if(f != NULL)
+		fclose(f);
+	if(ok)
+		info("Klee history saved to %s", path.c_str());
+	else
+		warn("cannot write %s", path.c_str());
+}
+
+// One of the load patterns with the longest cycles and the most CV values in
+// TheXOR-Klee-index.txt, written by headless/explore; the load and bus
+// switches are set to it.
+void KleeWidget::suggestPattern()
+{
+	std::string path = assetLocal("TheXOR-Klee-index.txt");
+	FILE *f = fopen(path.c_str(), "r");
+	if(f == NULL)
+	{
+		warn("cannot open %s", path.c_str());
+		return;
+	}
+
+	struct Suggestion
+	{
+		unsigned load;
+		char bus[17];
+		int cycle;
+		int distinct;
+	};
+	std::vector<Suggestion> suggestions;
+	char line[256];
+	int length, x28, binv, bus2, bus1load;
+	bool match = fgets(line, sizeof(line), f) != NULL
+		&& sscanf(line, "# Klee index: length %i, x28 %i, binv %i, bus2 %i, bus1load %i", &length, &x28, &binv, &bus2, &bus1load) == 5
+		&& length == ((Klee *)module)->Length()
+		&& x28 == (module->params[Klee::X28_X16].value >= 0.5) && binv == (module->params[Klee::B_INV].value >= 0.5)
+		&& bus2 == (module->params[Klee::BUS2_MODE].value >= 0.5) && bus1load == (module->params[Klee::BUS1_LOAD].value >= 0.5);
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		Suggestion s;
+		int transient;
+		if(line[0] != '#' && sscanf(line, "%x %16s %i %i %i", &s.load, s.bus, &transient, &s.cycle, &s.distinct) == 5 && strlen(s.bus) == 16)
+			suggestions.push_back(s);
+	}
+	fclose(f);
+	if(suggestions.empty())
+	{
+		warn("no patterns in %s", path.c_str());
+		return;
+	}
+	if(!match)
+		warn("%s was made with other mode switches or length", path.c_str());
+
+	int best = std::min((int)suggestions.size(), 32);
+	std::partial_sort(suggestions.begin(), suggestions.begin() + best, suggestions.end(), [](const Suggestion &a, const Suggestion &b)
+	{
+		return a.cycle != b.cycle ? a.cycle > b.cycle : a.distinct > b.distinct;
+	});
+	const Suggestion &s = suggestions[randomu32() % best];
+	for(int k = 0; k < 16; k++)
+	{
+		ParamWidget *pwdg = getParam(Klee::LOAD_BUS + k);
+		if(pwdg != NULL)
+			pwdg->setValue((s.load >> k) & 1);
+		pwdg = getParam(Klee::GROUPBUS + k);
+		if(pwdg != NULL && s.bus[k] >= '0' && s.bus[k] <= '2')
+			pwdg->setValue(s.bus[k] - '0');
+	}
+	info("Klee load pattern %04x: cycle of %i steps, %i CV values", s.load, s.cycle, s.distinct);
+}
+
+KleePolyWidget::KleePolyWidget()
+{
+	Klee *module = (Klee *)this->module;
+	module->setVoices(4);
+
+	float x = box.size.x;
+	box.size.x += 16 * RACK_GRID_WIDTH;
+	SVGPanel *panel = new SVGPanel();
+	panel->box.pos = Vec(x, 0);
+	panel->box.size = Vec(16 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT);
+	panel->setBackground(SVG::load(assetPlugin(plugin, "res/KleePoly.svg")));
+	addChild(panel);
+	addChild(createScrew<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
+	addChild(createScrew<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, box.size.y - RACK_GRID_WIDTH)));
+
+	// voices 1-8 on the left, 9-16 on the right: CV, gate, load offset and random threshold
+	for(int v = 0; v < Klee::MAX_VOICES; v++)
+	{
+		Vec pos(x + 18 + 118 * (v / 8), 40 + 40 * (v % 8));
+		addOutput(createOutput<PJ301MPort>(pos, module, Klee::VOICE_OUT + 2 * v));
+		addOutput(createOutput<PJ301GPort>(pos.plus(Vec(27, 0)), module, Klee::VOICE_OUT + 2 * v + 1));
+		addParam(createParam<SnappedTrimpot>(pos.plus(Vec(55, 4)), module, Klee::VOICE_OFFSET + v, 0.0, 15.0, v));
+		addParam(createParam<Trimpot>(pos.plus(Vec(75, 4)), module, Klee::VOICE_THRESHOLD + v, -1.0, 1.0, 0.0));
+	}
+
+	build_param_index();
+}
+
+Menu *KleePolyWidget::addContextMenu(Menu *menu)
+{
+	KleeWidget::addContextMenu(menu);
+	int voices = ((Klee *)module)->Voices();
+	for(int n = 1; n <= Klee::MAX_VOICES; n++)
+	{
+		SeqMenuItem<KleePolyWidget> *item = new SeqMenuItem<KleePolyWidget>(("Voices: " + std::to_string(n)).c_str(), this, n);
+		item->rightText = voices == n ? "\u2714" : "";
+		menu->addChild(item);
+	}
+	return menu;
+}
+
+void KleePolyWidget::onMenu(int voices)
+{
+	((Klee *)module)->setVoices(voices);
+}
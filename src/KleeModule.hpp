@@ -0,0 +1,321 @@
+#pragma once
+
+struct Klee : BlockProcessing<Klee>
+{
+	static const int MAX_VOICES = 16;
+	static const int NUM_SNAPSHOTS = 64;
+	static const int HISTORY_SIZE = 1024;
+
+	enum ParamIds
+	{
+		PITCH_KNOB,
+		GROUPBUS = PITCH_KNOB + 16,
+		LOAD_BUS = GROUPBUS + 16,
+		LOAD_PARAM = LOAD_BUS + 16,
+		STEP_PARAM,
+		X28_X16,
+		RND_PAT,
+		B_INV,
+		RND_THRESHOLD,
+		BUS1_LOAD,
+		BUS_MERGE,
+		RANGE = BUS_MERGE + 3,
+		BUS2_MODE,
+		SNAPSHOT,
+		RECALL_PARAM,
+		STORE_PARAM,
+		VOICE_OFFSET,     // stages the load pattern of each voice is rotated by
+		VOICE_THRESHOLD = VOICE_OFFSET + MAX_VOICES,     // added to the random threshold
+		NUM_PARAMS = VOICE_THRESHOLD + MAX_VOICES
+	};
+
+	enum InputIds
+	{
+		LOAD_INPUT,
+		EXT_CLOCK_INPUT,
+		RND_THRES_IN,
+		RANGE_IN,
+		SNAPSHOT_INPUT,
+		RECALL_INPUT,
+		NUM_INPUTS
+	};
+
+	enum OutputIds
+	{
+		CV_A,
+		CV_B,
+		CV_AB,
+		CV_A__B,
+		GATE_OUT,
+		TRIG_OUT = GATE_OUT + 3,
+		temp = TRIG_OUT + 3,
+		VOICE_OUT,     // CV and gate of each voice
+		NUM_OUTPUTS = VOICE_OUT + 2 * MAX_VOICES
+	};
+
+	enum LightIds
+	{
+		LED_PITCH,
+
+		LED_BUS = LED_PITCH + 16,
+		temp1 = LED_BUS + 3,
+		NUM_LIGHTS
+	};
+
+	Klee() : BlockProcessing(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	{
+#ifdef LAUNCHPAD
+		drv = new LaunchpadBindingDriver(Scene1, 1);
+#endif
+		set_length(16);
+		for(int k = 0; k < 3; k++)
+			triggerCount[k] = 0;
+		activeTriggers = 0;
+		onSampleRateChange();
+		for(int v = 0; v < MAX_VOICES; v++)
+		{
+			params[VOICE_OFFSET + v].value = v;
+			bus_active[v] = 0;
+			cycleLength[v] = cyclePos[v] = 0;
+		}
+		for(int k = 0; k < NUM_SNAPSHOTS; k++)
+			snapshot[k].used = false;
+		on_loaded();
+	}
+
+#ifdef LAUNCHPAD
+	~Klee()
+	{
+		delete drv;
+	}
+#endif
+
+	void fromJson(json_t *root) override
+	{
+		Module::fromJson(root);
+		rng.fromJson(json_object_get(root, "rng"));
+		setAudioRate(json_integer_value(json_object_get(root, "audioRate")) != 0);
+		// patches from before the voice params kept them in a "voices" array
+		json_t *voicesJ = json_object_get(root, "voices");
+		for(int v = 0; v < (int)json_array_size(voicesJ) && v < MAX_VOICES; v++)
+		{
+			json_t *voiceJ = json_array_get(voicesJ, v);
+			params[VOICE_OFFSET + v].value = json_integer_value(json_object_get(voiceJ, "offset")) & 15;
+			params[VOICE_THRESHOLD + v].value = json_number_value(json_object_get(voiceJ, "threshold"));
+		}
+		if(json_array_size(voicesJ) > 0)
+			recalls++;     // the trimpots follow
+		json_t *numVoicesJ = json_object_get(root, "numVoices");
+		if(numVoicesJ != NULL)
+			setVoices(json_integer_value(numVoicesJ));
+		json_t *lengthJ = json_object_get(root, "length");
+		if(lengthJ != NULL)
+			setLength(json_integer_value(lengthJ));
+		snapshotsFromJson(json_object_get(root, "snapshots"));
+		on_loaded();
+	}
+	json_t *toJson() override
+	{
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "rng", rng.toJson());
+		json_object_set_new(rootJ, "audioRate", json_integer(AudioRate()));
+		json_object_set_new(rootJ, "numVoices", json_integer(Voices()));
+		json_object_set_new(rootJ, "length", json_integer(Length()));
+		json_object_set_new(rootJ, "snapshots", snapshotsToJson());
+		return rootJ;
+	}
+	void reset() override { rng.Reset(); load(); }
+	void onSampleRateChange() override { triggerSamples = std::max(1, (int)roundf(pulseTime * engineGetSampleRate())); }
+	void randomize() override { rng.Seed(randomu32()); load(); }
+
+	// Audio rate clocking: the clock edges are timed within the sample and the
+	// CV, gate and trigger steps band limited, at the cost of one sample of
+	// latency. The switch lands at the start of the next block.
+	bool AudioRate() const
+	{
+		int on = audioRateRequest.load(std::memory_order_relaxed);
+		return on >= 0 ? on != 0 : audioRate;
+	}
+	void setAudioRate(bool on) { audioRateRequest.store(on, std::memory_order_relaxed); }
+
+	// Voices: up to MAX_VOICES registers clocked together, sharing the knobs
+	// and the bus switches, each with its own rotation of the load pattern
+	// and random threshold (VOICE_OFFSET and VOICE_THRESHOLD, on the trimpots
+	// of the Klee Poly strip). Voice 0 drives the panel outputs and lights; the
+	// VOICE_OUT pairs carry CV A+B and the bus 1 gate of every voice. A new
+	// count lands on the next clock.
+	int Voices() const
+	{
+		int n = voicesRequest.load(std::memory_order_relaxed);
+		return n != 0 ? n : numVoices;
+	}
+	void setVoices(int n) { voicesRequest.store(std::max(1, std::min(n, MAX_VOICES)), std::memory_order_relaxed); }
+
+	// Register length: 16, 32 or 64 stages, A the low half and B the high
+	// one. The knobs, bus and load switches page over each half: stage k of
+	// a bank uses the controls of its stage k % 8. A new length lands on the
+	// next clock, which plays the load pattern in place of a shift.
+	int Length() const
+	{
+		int n = lengthRequest.load(std::memory_order_relaxed);
+		return n != 0 ? n : length;
+	}
+	void setLength(int n) { lengthRequest.store(valid_length(n), std::memory_order_relaxed); }
+
+	// Snapshots: NUM_SNAPSHOTS slots of the registers, bus switches and pitch
+	// knobs, the slot picked by the SNAPSHOT knob plus SNAPSHOT_INPUT (1/12V
+	// per slot). A store takes the state at once; a recall lands on the next
+	// clock, which plays the stored state in place of a shift.
+	// History: the last HISTORY_SIZE steps of voice 0, written on each clock
+	// into a ring the UI reads without locking. HistoryCount() is the number
+	// of steps written so far, wrapping; ReadHistory() copies the newest n
+	// of them, oldest first, and returns how many it got.
+	struct HistoryEntry
+	{
+		uint32_t time;    // in samples, wrapping
+		uint64_t reg;
+		uint8_t length;
+		uint8_t bus;      // bit k: bus k
+		float cv[4];      // CV_A to CV_A__B
+	};
+	uint32_t HistoryCount() const { return historyHead.load(std::memory_order_acquire); }
+	int ReadHistory(HistoryEntry *dest, int n) const
+	{
+		uint32_t head = historyHead.load(std::memory_order_acquire);
+		n = (int)std::min<uint32_t>(n, std::min<uint32_t>(head, HISTORY_SIZE));
+		uint32_t first = head - n;
+		for(int k = 0; k < n; k++)
+			dest[k] = history[(first + k) % HISTORY_SIZE];
+		// the writer may have gone round over the oldest ones meanwhile
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t lost = historyHead.load(std::memory_order_relaxed) - head;
+		if(lost == 0)
+			return n;
+		int skip = std::min<int>(n, std::max<int>(0, (int)lost + 1 - (HISTORY_SIZE - n)));
+		std::copy(dest + skip, dest + n, dest);
+		return n - skip;
+	}
+
+	int Recalls() const { return recalls; }
+	int SelectedSnapshot() const
+	{
+		int slot = (int)roundf(params[SNAPSHOT].value + inputs[SNAPSHOT_INPUT].value * 12);
+		return std::max(0, std::min(slot, NUM_SNAPSHOTS - 1));
+	}
+
+#ifdef LAUNCHPAD
+	LaunchpadBindingDriver *drv;
+	float connected;
+#endif
+
+private:
+	friend struct BlockProcessing<Klee>;
+	static const int NUM_SMOOTHED = TRIG_OUT + 3;   // CV_A to the last trigger
+	const float pulseTime = 0.002;      //2msec trigger
+	void beginBlock();
+	void process();
+	void endBlock();
+	void updateLights();
+	int nextEvent(const float *const *in, int n, int frames);
+	void sr_rotate();
+	uint64_t rotate(uint64_t reg, bool x28, uint64_t inv);
+	uint64_t rotate_left(uint64_t reg, int n);
+	uint8_t bus_of(uint64_t reg, bool and2);
+	static int valid_length(int n) { return n >= 64 ? 64 : (n >= 32 ? 32 : 16); }
+	void set_length(int n);
+	void apply_length();
+	void apply_voices();
+	void apply_audio_rate();
+	uint64_t page(uint16_t bits);
+	float bank_sum(uint64_t reg, int bank);
+	int cycle_mode();
+	bool replay_cycle();
+	bool build_cycle(int mode);
+	bool chance(int v);
+	void populate_gate(int clk);
+	void update_bus();
+	void update_bus_masks();
+	void update_pitch(int k);
+	void check_params();
+	void smooth_outputs(int from, int to, float edge);
+	void load();
+	void load_voice(int v);
+	uint64_t load_pattern();
+	void on_loaded();
+	void populate_outputs();
+	void check_triggers();
+	void record_history();
+	void store_snapshot(int slot);
+	void recall_snapshot();
+	json_t *snapshotsToJson();
+	void snapshotsFromJson(json_t *snapshotsJ);
+	bool isSwitchOn(int ptr);
+	int getValue3(int k);
+	SchmittTrigger loadTrigger;
+	SchmittTrigger2 clockTrigger;
+	SchmittTrigger recallTrigger;
+	SchmittTrigger storeTrigger;
+	int triggerSamples;     // pulseTime in samples
+	int triggerCount[3];    // samples left of each bus trigger, 0 when off
+	int activeTriggers;     // bit k set while triggerCount[k] > 0
+	RNG rng;
+	float loadParam;
+	float stepParam;
+	float recallParam;
+	float storeParam;
+
+	// stage k of voice v is bit k of shiftRegister[v]
+	uint64_t shiftRegister[MAX_VOICES];
+	int length;
+	uint64_t lengthMask;     // the stages of the register
+	uint64_t splitMask;      // 2x mode: the stages a shift fills from the one before
+	uint64_t feedbackMask;   // 2x mode: the first stage of A and B
+	uint64_t bankRepeat;     // a one in the first stage of every byte of A
+	std::atomic<int> lengthRequest{0};   // from the UI, 0 when none
+	int numVoices = 1;
+	std::atomic<int> voicesRequest{0};   // from the UI, 0 when none
+	int voice_offset(int v) const { return (int)roundf(params[VOICE_OFFSET + v].value) & 15; }
+
+	uint8_t bus_active[MAX_VOICES];   // bit k: bus k of voice v
+	bool bus(int k) const { return (bus_active[0] >> k) & 1; }
+
+	// Without random injection and bus 1 load, every register runs through a
+	// fixed cycle of at most 64 states: it is worked out on the first clock
+	// and replayed until a load, a switch or the bus assignments change.
+	struct CycleState
+	{
+		uint64_t reg;
+		uint8_t bus;
+	};
+	CycleState cycle[MAX_VOICES][64];
+	int cycleLength[MAX_VOICES];
+	int cyclePos[MAX_VOICES];
+	int cycleMode;
+	bool cycleValid = false;
+	uint64_t busMask[3];     // the stages assigned to each bus
+	float groupBus[16];      // the GROUPBUS values the masks were built from
+	float pitch[16];         // the PITCH_KNOB values the sums were built from
+	float pitchSum[2][256];  // sum of the pitch knobs of each bank, for every register byte
+
+	bool audioRate = false;
+	std::atomic<int> audioRateRequest{-1};   // from the UI, -1 when none
+	float lastClock = 0;
+	float naive[NUM_OUTPUTS];    // the outputs as they step
+	float pending[NUM_OUTPUTS];  // the band limited outputs of the next sample
+
+	struct Snapshot
+	{
+		bool used;
+		int length;
+		uint64_t reg[MAX_VOICES];
+		float bus[16];     // GROUPBUS
+		float pitch[16];   // PITCH_KNOB
+	};
+	Snapshot snapshot[NUM_SNAPSHOTS];
+	int recallSlot = -1;    // recalled on the next clock
+	int recalls = 0;        // for the widget to follow the params set here
+
+	uint32_t sampleCount = 0;
+	HistoryEntry history[HISTORY_SIZE];
+	std::atomic<uint32_t> historyHead{0};
+};
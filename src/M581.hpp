@@ -1,5 +1,6 @@
 #include "common.hpp"
 #include "dsp/digital.hpp"
+#include <limits.h>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
@@ -44,48 +45,25 @@ struct CounterSwitch : SVGSlider
 	void randomize() override { setValue(roundf(randomf() * maxValue)); }
 };
 
-struct RunModeDisplay : TransparentWidget
+struct RunModeDisplay : CachedDisplay
 {
 	float *mode;
-	std::shared_ptr<Font> font;
 
-	RunModeDisplay()
-	{
-		font = Font::load(assetPlugin(plugin, "res/Segment7Standard.ttf"));
-	}
+	RunModeDisplay() : CachedDisplay(Vec(2, 18)) {}
 
-	void draw(NVGcontext *vg) override
+	void step() override
 	{
-		// Background
-		NVGcolor backgroundColor = nvgRGB(0x20, 0x20, 0x20);
-		NVGcolor borderColor = nvgRGB(0x10, 0x10, 0x10);
-		nvgBeginPath(vg);
-		nvgRoundedRect(vg, 0.0, 0.0, box.size.x, box.size.y, 4.0);
-		nvgFillColor(vg, backgroundColor);
-		nvgFill(vg);
-		nvgStrokeWidth(vg, 1.0);
-		nvgStrokeColor(vg, borderColor);
-		nvgStroke(vg);
-		// text
-		nvgFontSize(vg, 18);
-		nvgFontFaceId(vg, font->handle);
-		nvgTextLetterSpacing(vg, 2.5);
-
-		Vec textPos = Vec(2, 18);
-		NVGcolor textColor = nvgRGB(0xdf, 0xd2, 0x2c);
-		nvgFillColor(vg, nvgTransRGBA(textColor, 16));
-		nvgText(vg, textPos.x, textPos.y, "~~", NULL);
-
-		textColor = nvgRGB(0xda, 0xe9, 0x29);
-		nvgFillColor(vg, nvgTransRGBA(textColor, 16));
-		nvgText(vg, textPos.x, textPos.y, "\\\\", NULL);
-
-		textColor = nvgRGB(0xf0, 0x00, 0x00);
-		nvgFillColor(vg, textColor);
-		nvgText(vg, textPos.x, textPos.y, run_modes[int(std::round(*mode))], NULL);
+		int m = int(std::round(*mode));
+		if(m != shown)
+		{
+			shown = m;
+			setText(run_modes[m]);
+		}
+		CachedDisplay::step();
 	}
 
 private:
+	int shown = -1;
 	const char *run_modes[5] = {
 		"FWD",
 		"BWD",
@@ -2,7 +2,7 @@
 #include "M581Types.hpp"
 #include <sstream>
 
-struct M581 : Module
+struct M581 : BlockProcessing<M581>
 {
 	enum ParamIds
 	{
@@ -41,7 +41,7 @@ struct M581 : Module
 		NUM_LIGHTS
 	};
 
-	M581() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	M581() : BlockProcessing(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
 	{
 #ifdef LAUNCHPAD
 		drv = new LaunchpadBindingDriver(Scene2, 3);
@@ -49,6 +49,7 @@ struct M581 : Module
 		drv->SetAutoPageKey(LaunchpadKey::NOTE, 1);
 		drv->SetAutoPageKey(LaunchpadKey::DEVICE, 2);
 #endif
+		onSampleRateChange();
 		on_loaded();
 	}
 
@@ -59,15 +60,20 @@ struct M581 : Module
 	}
 #endif
 
-	void step() override;
-	void reset() override { load(); }
-	void randomize() override { load(); }
+	void reset() override { rng.Reset(); load(); }
+	void onSampleRateChange() override { Timer.SetSampleRate(engineGetSampleRate()); }
+	void randomize() override { rng.Seed(randomu32()); load(); }
 
-	void fromJson(json_t *root) override { Module::fromJson(root); on_loaded(); }
+	void fromJson(json_t *root) override
+	{
+		Module::fromJson(root);
+		rng.fromJson(json_object_get(root, "rng"));
+		on_loaded();
+	}
 	json_t *toJson() override
 	{
 		json_t *rootJ = json_object();
-
+		json_object_set_new(rootJ, "rng", rng.toJson());
 		return rootJ;
 	}
 
@@ -87,11 +93,18 @@ struct M581 : Module
 #endif
 
 private:
+	friend struct BlockProcessing<M581>;
+	void beginBlock();
+	void process();
+	void endBlock();
+	void updateLights();
+	int nextEvent(const float *const *in, int n, int frames);
 	CV_LINE cvControl;
 	GATE_LINE gateControl;
 	TIMER Timer;
 	STEP_COUNTER stepCounter;
 	ParamGetter getter;
+	RNG rng;
 
 	void _reset();
 	void on_loaded();
@@ -101,6 +114,8 @@ private:
 	bool any();
 	SchmittTrigger clockTrigger;
 	SchmittTrigger resetTrigger;
+	int ledStep;
+	int ledSubdiv;
 };
 
 void M581::on_loaded()
@@ -113,7 +128,7 @@ void M581::on_loaded()
 
 void M581::load()
 {
-	stepCounter.Set(&getter);
+	stepCounter.Set(&getter, &rng);
 	cvControl.Set(&getter);
 	gateControl.Set(&getter);
 	getter.Set(this);
@@ -128,49 +143,85 @@ void M581::_reset()
 	showCurStep(0, 0);
 }
 
-void M581::step()
+void M581::beginBlock()
+{
+	getter.Update();
+	gateControl.SetLength(Timer.Samples(getter.GateTime()));
+}
+
+void M581::process()
 {
 	if(resetTrigger.process(inputs[RESET].value))
 	{
+		COUNT(this, resets);
 		_reset();
 	} else
 	{
-		Timer.Step(); 
+		Timer.Step();
 
 		if(clockTrigger.process(inputs[CLOCK].value) && any())
+		{
+			COUNT(this, clockEdges);
 			beginNewStep();
+		}
 
 		outputs[CV].value = cvControl.Play(Timer.Elapsed());
 		outputs[GATE].value = gateControl.Play(&Timer, stepCounter.PulseCounter());
 	}
+}
 
+// the CV changes on every sample of a slide, the gate where its time runs out
+int M581::nextEvent(const float *const *in, int n, int frames)
+{
+	if(cvControl.Sliding())
+		return n;
+
+	int hold = gateControl.Hold(&Timer, stepCounter.PulseCounter());
+	int next = hold < frames - n ? n + hold : frames;
+	next = nextEdge(resetTrigger, buffer(in, RESET), inputs[RESET].value, 0.0, n, next);
+	next = nextEdge(clockTrigger, buffer(in, CLOCK), inputs[CLOCK].value, 0.0, n, next);
+	Timer.Skip(next - n);
+	return next;
+}
+
+void M581::endBlock()
+{
 #ifdef LAUNCHPAD
 	connected = drv->Connected() ? 1.0 : 0.0;
 	drv->ProcessLaunchpad();
+	COUNT_LAUNCHPAD(this, drv);
 #endif
 }
 
+void M581::updateLights()
+{
+	for(int k = 0; k < 8; k++)
+	{
+		lights[LED_STEP + k].value = k == ledStep ? 1.0 : 0.0;
+		lights[LED_SUBDIV + k].value = k == ledSubdiv ? 1.0 : 0.0;
+	}
+	COUNT_N(this, lightWrites, 16);
+}
+
 void M581::beginNewStep()
 {
 	int cur_step;
 	if(stepCounter.Play(&Timer, &cur_step)) // inizia un nuovo step?
 	{
+		COUNT(this, steps);
 		gateControl.Begin(cur_step);
-		cvControl.Begin(cur_step);	// 	glide note increment in 1/10 di msec. param = new note value
+		cvControl.Begin(cur_step, Timer.SampleRate());
 	}
 
 	showCurStep(cur_step, stepCounter.PulseCounter());
 }
 
+// the leds are drawn by updateLights()
 void M581::showCurStep(int cur_step, int sub_div)
 {
-	int lled = cur_step;
-	int sled = sub_div;
-	for(int k = 0; k < 8; k++)
-	{
-		lights[LED_STEP + k].value = k == lled ? 1.0 : 0.0;
-		lights[LED_SUBDIV + k].value = k == sled ? 1.0 : 0.0;
-	}
+	ledStep = cur_step;
+	ledSubdiv = sub_div;
+	markLights();
 }
 
 bool M581::any()
@@ -186,6 +237,7 @@ bool M581::any()
 
 M581Widget::M581Widget()
 {
+	LoadTimer timer("M581 instance");
 	M581 *module = new M581();
 	setModule(module);
 	box.size = Vec(27 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT);
@@ -290,6 +342,8 @@ M581Widget::M581Widget()
 #ifdef LAUNCHPAD
 	addChild(new DigitalLed(360, 20, &module->connected));
 #endif
+
+	build_param_index();
 }
 
 Menu *M581Widget::addContextMenu(Menu *menu)
@@ -312,13 +366,39 @@ void M581Widget::onMenu(int action)
 	}
 }
 
-bool ParamGetter::IsEnabled(int numstep) { return pModule->params[M581::STEP_ENABLE + numstep].value > 0.0; }
-bool ParamGetter::IsSlide(int numstep) { return pModule->params[M581::STEP_ENABLE + numstep].value > 1.0; }
-int ParamGetter::GateMode(int numstep) { return std::round(pModule->params[M581::GATE_SWITCH + numstep].value); }
-int ParamGetter::PulseCount(int numstep) { return std::round(pModule->params[M581::COUNTER_SWITCH + numstep].value); }
-float ParamGetter::Note(int numstep) { return pModule->params[M581::STEP_NOTES + numstep].value * (pModule->params[M581::MAXVOLTS].value > 0 ? 5.0 : 3.0); }
-int ParamGetter::RunMode() { return std::round(pModule->params[M581::RUN_MODE].value); }
-int ParamGetter::NumSteps() { return std::round(pModule->params[M581::NUM_STEPS].value); }
-float ParamGetter::SlideTime() { return pModule->params[M581::SLIDE_TIME].value; }
-float ParamGetter::GateTime() { return pModule->params[M581::GATE_TIME].value; }
-int ParamGetter::StepDivision() { return std::round(pModule->params[M581::STEP_DIV].value) + 1; }
+static_assert(sizeof(Param) == sizeof(float), "ParamGetter compares the params as floats");
+
+void ParamGetter::Set(M581 *module)
+{
+	pModule = module;
+	values.assign(M581::NUM_PARAMS, 0.0);
+	refresh();
+}
+
+void ParamGetter::Update()
+{
+	// a Param is just its value: one compare of the whole array
+	if(memcmp(&pModule->params[0], values.data(), M581::NUM_PARAMS * sizeof(float)) != 0)
+		refresh();
+}
+
+void ParamGetter::refresh()
+{
+	for(int k = 0; k < M581::NUM_PARAMS; k++)
+		values[k] = pModule->params[k].value;
+
+	float range = values[M581::MAXVOLTS] > 0 ? 5.0 : 3.0;
+	for(int k = 0; k < 8; k++)
+	{
+		step[k].enabled = values[M581::STEP_ENABLE + k] > 0.0;
+		step[k].slide = values[M581::STEP_ENABLE + k] > 1.0;
+		step[k].gateMode = std::round(values[M581::GATE_SWITCH + k]);
+		step[k].pulseCount = std::round(values[M581::COUNTER_SWITCH + k]);
+		step[k].note = values[M581::STEP_NOTES + k] * range;
+	}
+	runMode = std::round(values[M581::RUN_MODE]);
+	numSteps = std::round(values[M581::NUM_STEPS]);
+	slideTime = values[M581::SLIDE_TIME];
+	gateTime = values[M581::GATE_TIME];
+	stepDivision = std::round(values[M581::STEP_DIV]) + 1;
+}
@@ -1,24 +1,45 @@
 struct M581;
+// the params as the sequencer uses them, rounded once per block and only
+// when one of them has moved
 struct ParamGetter
 {
 public:
 	ParamGetter() { pModule = NULL; }
-	void Set(M581 *module) { pModule = module; }
-	bool IsEnabled(int numstep);
-	bool IsSlide(int numstep);
-	int GateMode(int numstep);
-	int PulseCount(int numstep);
-	float Note(int numstep);
+	void Set(M581 *module);
+	void Update();
+	bool IsEnabled(int numstep) const { return step[numstep].enabled; }
+	bool IsSlide(int numstep) const { return step[numstep].slide; }
+	int GateMode(int numstep) const { return step[numstep].gateMode; }
+	int PulseCount(int numstep) const { return step[numstep].pulseCount; }
+	float Note(int numstep) const { return step[numstep].note; }
 
 	// Generic
-	int RunMode();
-	int NumSteps();
-	float SlideTime();
-	float GateTime();
-	int StepDivision();
+	int RunMode() const { return runMode; }
+	int NumSteps() const { return numSteps; }
+	float SlideTime() const { return slideTime; }
+	float GateTime() const { return gateTime; }
+	int StepDivision() const { return stepDivision; }
 
 private:
+	struct STEP
+	{
+		bool enabled;
+		bool slide;
+		int gateMode;
+		int pulseCount;
+		float note;
+	};
+
 	M581 * pModule;
+	std::vector<float> values;    // the params the cache was made from
+	STEP step[8];
+	int runMode;
+	int numSteps;
+	int stepDivision;
+	float slideTime;
+	float gateTime;
+
+	void refresh();
 };
 
 
@@ -33,14 +54,15 @@ struct CV_LINE
 
 	void Set(ParamGetter *get) { pGet = get; }
 
-	void Begin(int cur_step)
+	// the slide increment is per sample
+	void Begin(int cur_step, float sampleRate)
 	{
 		curNote = pGet->Note(cur_step);
 		if(startNoteValue < 0.0)
 			startNoteValue = curNote;
 
 		if(pGet->IsSlide(cur_step))
-			slideNoteIncrement = (curNote - startNoteValue) / pGet->SlideTime();
+			slideNoteIncrement = (curNote - startNoteValue) / (pGet->SlideTime() * sampleRate);
 		else
 		{
 			startNoteValue = curNote;
@@ -48,7 +70,9 @@ struct CV_LINE
 		}
 	}
 
-	float Play(float elapsed)
+	bool Sliding() const { return slideNoteIncrement != 0; }
+
+	float Play(uint32_t elapsed)
 	{
 		float cv = startNoteValue + slideNoteIncrement * elapsed;
 		if(slideNoteIncrement < 0 && curNote > cv)		// inc negativo ---> cv potrebbe essere INFERIORE a target
@@ -75,7 +99,8 @@ struct GATE_LINE
 private:
 	ParamGetter * pGet;
 	int curStep;
-	float gate_len(float elapsedTime) { return elapsedTime > pGet->GateTime() ? LVL_OFF : LVL_ON; }
+	uint32_t gateLength;    // in samples
+	float gate_len(uint32_t elapsed) { return elapsed > gateLength ? LVL_OFF : LVL_ON; }
 
 public:
 	void Reset()
@@ -90,6 +115,33 @@ public:
 		curStep = cur_step;
 	}
 
+	void SetLength(uint32_t samples) { gateLength = samples; }
+
+	// samples after the current one that Play() gives the same level for,
+	// unless a clock or a reset comes in; INT_MAX when it does not change
+	int Hold(const TIMER *timer, int pulseCount)
+	{
+		uint32_t elapsed;
+		switch(pGet->GateMode(curStep))
+		{
+		case 1:
+			elapsed = timer->Elapsed();
+			break;
+
+		case 2:
+			if((pulseCount % pGet->StepDivision()) != 0)
+				return INT_MAX;
+			elapsed = timer->StopWatch();
+			break;
+
+		default:
+			return INT_MAX;
+		}
+		if(elapsed > gateLength)
+			return INT_MAX;
+		return (int)std::min<uint32_t>(gateLength - elapsed, INT_MAX);
+	}
+
 	float Play(TIMER *timer, int pulseCount)
 	{
 		float rv = LVL_OFF;
@@ -134,7 +186,11 @@ struct STEP_COUNTER
 		timer->Reset();
 	}
 
-	void Set(ParamGetter *get) { pGet = get; }
+	void Set(ParamGetter *get, RNG *rng)
+	{
+		pGet = get;
+		pRng = rng;
+	}
 	int CurStep() { return curStep % 8; }
 	int PulseCounter() { return pulseCounter; }
 
@@ -155,12 +211,13 @@ struct STEP_COUNTER
 
 private:
 	ParamGetter * pGet;
+	RNG *pRng;
 	int pulseCounter;
 	bool pp_rev;
 	int curStep;
 
-	bool testaCroce() { return randomf() > 0.5; }
-	int getRand(int rndMax) { return int(randomf() * rndMax); }
+	bool testaCroce() { return pRng->Uniform() > 0.5; }
+	int getRand(int rndMax) { return int(pRng->Uniform() * rndMax); }
 
 	int get_next_step(int current)
 	{
@@ -2,7 +2,7 @@
 #include "rntSequencer.hpp"
 #include <sstream>
 
-struct Renato : Module
+struct Renato : BlockProcessing<Renato>
 {
 	enum ParamIds
 	{
@@ -36,7 +36,7 @@ struct Renato : Module
 		NUM_LIGHTS = LED_1 + 16
 	};
 
-	Renato() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	Renato() : BlockProcessing(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
 	{
 #ifdef LAUNCHPAD
 		drv = new LaunchpadBindingDriver(Scene3, 2);
@@ -53,7 +53,6 @@ struct Renato : Module
 	}
 #endif
 
-	void step() override;
 	void reset() override { load(); }
 
 	void fromJson(json_t *root) override { Module::fromJson(root); on_loaded(); }
@@ -71,6 +70,12 @@ struct Renato : Module
 #endif
 
 private:
+	friend struct BlockProcessing<Renato>;
+	void beginBlock();
+	void process();
+	void endBlock();
+	void updateLights();
+	int nextEvent(const float *const *in, int n, int frames);
 	void on_loaded();
 	void load();
 	void led(int n) { for(int k = 0; k < 16; k++) lights[LED_1 + k].value = k == n ? 10.0 : 0.0; }
@@ -80,6 +85,10 @@ private:
 	bool _gateY(int n) { return params[GATEY_1 + n].value > 0; }
 	rntSequencer seqX;
 	rntSequencer seqY;
+	bool seek_mode;
+	float count_mode_x;
+	float count_mode_y;
+	int ledCell;
 };
 
 bool Access(Renato *pr, bool is_x, int p) { return is_x ? pr->_accessX(p) : pr->_accessY(p); }
@@ -96,32 +105,73 @@ void Renato::load()
 {
 	seqX.Reset();
 	seqY.Reset();
+	ledCell = -1;
+	markLights();
 }
 
-void Renato::step()
+void Renato::beginBlock()
 {
-	bool seek_mode = params[SEEKSLEEP].value > 0;
-	int clkX = seqX.Step(inputs[XCLK].value, params[COUNTMODE_X].value, seek_mode, this, true);
-	int clkY = seqY.Step(inputs[YCLK].value, params[COUNTMODE_Y].value, seek_mode, this, false);
+	seek_mode = params[SEEKSLEEP].value > 0;
+	count_mode_x = params[COUNTMODE_X].value;
+	count_mode_y = params[COUNTMODE_Y].value;
+}
+
+void Renato::process()
+{
+	int clkX = seqX.Step(inputs[XCLK].value, count_mode_x, seek_mode, this, true);
+	int clkY = seqY.Step(inputs[YCLK].value, count_mode_y, seek_mode, this, false);
+#ifdef USE_COUNTERS
+	int edges = (clkX == 1) + (clkY == 1);
+	COUNT_N(this, clockEdges, edges);
+	COUNT_N(this, steps, edges);
+#endif
+	if(clkX != 0 || clkY != 0)
+		markLights();
 	int n = xy(seqX.Position(), seqY.Position());
 	if(_access(n))
 	{
 		if(_gateX(n))
-			seqX.Gate(clkX, &outputs[XGATE], &lights[LED_GATEX]);
+			seqX.Gate(clkX, &outputs[XGATE]);
 
 		if(_gateY(n))
-			seqY.Gate(clkY, &outputs[YGATE], &lights[LED_GATEY]);
+			seqY.Gate(clkY, &outputs[YGATE]);
 
 		outputs[CV].value = params[VOLTAGE_1 + n].value;
-		led(n);
+		if(ledCell != n)
+		{
+			ledCell = n;
+			markLights();
+		}
 	}
+}
 
+int Renato::nextEvent(const float *const *in, int n, int frames)
+{
+	int next = seqX.NextEdge(buffer(in, XCLK), inputs[XCLK].value, n, frames);
+	return seqY.NextEdge(buffer(in, YCLK), inputs[YCLK].value, n, next);
+}
+
+void Renato::endBlock()
+{
 #ifdef LAUNCHPAD
 	connected = drv->Connected() ? 1.0 : 0.0;
 	drv->ProcessLaunchpad();
+	COUNT_LAUNCHPAD(this, drv);
 #endif
 }
 
+void Renato::updateLights()
+{
+	lights[LED_GATEX].value = outputs[XGATE].value;
+	lights[LED_GATEY].value = outputs[YGATE].value;
+	COUNT_N(this, lightWrites, 2);
+	if(ledCell >= 0)
+	{
+		led(ledCell);
+		COUNT_N(this, lightWrites, 16);
+	}
+}
+
 Menu *RenatoWidget::addContextMenu(Menu *menu)
 {
 	menu->addChild(new SeqMenuItem<RenatoWidget>("Randomize Pitch", this, RANDOMIZE_PITCH));
@@ -144,6 +194,7 @@ void RenatoWidget::onMenu(int action)
 
 RenatoWidget::RenatoWidget()
 {
+	LoadTimer timer("Renato instance");
 	Renato *module = new Renato();
 	setModule(module);
 	box.size = Vec(27 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT);
@@ -242,4 +293,6 @@ RenatoWidget::RenatoWidget()
 #ifdef LAUNCHPAD
 	addChild(new DigitalLed((box.size.x - 24) / 2, 5, &module->connected));
 #endif
+
+	build_param_index();
 }
@@ -14,6 +14,7 @@ Plugin *plugin;
 
 void init(rack::Plugin *p)
 {
+	LoadTimer timer("TheXOR startup");
 	plugin = p;
 	// This is the unique identifier for your plugin
 	p->slug = "TheXOR";
@@ -25,6 +26,7 @@ void init(rack::Plugin *p)
 
 	// For each module, specify the ModuleWidget subclass, manufacturer slug (for saving in patches), manufacturer human-readable name, module slug, and module name
 	p->addModel(createModel<KleeWidget>("TheXOR", "Klee", "Klee Sequencer", SEQUENCER_TAG));
+	p->addModel(createModel<KleePolyWidget>("TheXOR", "KleePoly", "Klee Poly Sequencer", SEQUENCER_TAG));
 	p->addModel(createModel<M581Widget>("TheXOR", "M581", "581 Sequencer", SEQUENCER_TAG));
 	p->addModel(createModel<Z8KWidget>("TheXOR", "Z8K", "Z8K Sequencer", SEQUENCER_TAG));
 	p->addModel(createModel<RenatoWidget>("TheXOR", "Renato", "Renato Sequencer", SEQUENCER_TAG));
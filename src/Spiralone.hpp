@@ -32,7 +32,6 @@ private:
 		RANDOMIZE_XPOSE
 	};
 	void createSequencer(int seq);
-	ModuleLightWidget *createLed(int seq, Vec pos, Module *module, int firstLightId, bool big = false);
 	NVGcolor color[NUM_SEQUENCERS];
 };
 
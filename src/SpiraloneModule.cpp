@@ -7,7 +7,6 @@ float AccessParam(Spiralone *p, int seq, int id) { return p->params[id + seq].va
 float AccessParam(Spiralone *p, int id) { return p->params[id].value; }
 Input *AccessInput(Spiralone *p, int seq, int id) { return &p->inputs[id + seq]; }
 float *AccessOutput(Spiralone *p, int seq, int id) { return &p->outputs[id + seq].value; }
-float *AccessLight(Spiralone *p, int id) { return &p->lights[id].value; }
 
 void Spiralone::on_loaded()
 {
@@ -21,21 +20,60 @@ void Spiralone::load()
 {
 	for(int k = 0; k < NUM_SEQUENCERS; k++)
 		sequencer[k].Reset(k, this);
+	markLights();
 }
 
-void Spiralone::step()
+void Spiralone::process()
 {
 	for(int k = 0; k < NUM_SEQUENCERS; k++)
-		sequencer[k].Step(k, this);
+	{
+		if(sequencer[k].Step(k, this) != 0)
+			markLights();
+	}
+}
+
+void Spiralone::beginBlock()
+{
+	for(int k = 0; k < NUM_SEQUENCERS; k++)
+		seqEvent[k] = -1;
+}
+
+// a sequencer's next event stays valid until it has been processed
+int Spiralone::nextEvent(const float *const *in, int n, int frames)
+{
+	int next = frames;
+	for(int k = 0; k < NUM_SEQUENCERS; k++)
+	{
+		if(seqEvent[k] < n)
+			seqEvent[k] = sequencer[k].NextEvent(k, this, buffer(in, RESET_1 + k), buffer(in, CLOCK_1 + k), n, frames);
+		next = std::min(next, seqEvent[k]);
+	}
+	return next;
+}
 
+void Spiralone::endBlock()
+{
 #ifdef LAUNCHPAD
 	connected = drv->Connected() ? 1.0 : 0.0;
 	drv->ProcessLaunchpad();
+	COUNT_LAUNCHPAD(this, drv);
 #endif
 }
 
+void Spiralone::updateLights()
+{
+	for(int k = 0; k < NUM_SEQUENCERS; k++)
+	{
+		int n = sequencer[k].Lit() ? sequencer[k].Position() : -1;
+		for(int i = 0; i < TOTAL_STEPS; i++)
+			lights[LED_SEQUENCE_1 + k * TOTAL_STEPS + i].value = i == n ? 10.0 : 0.0;
+	}
+	COUNT_N(this, lightWrites, NUM_SEQUENCERS * TOTAL_STEPS);
+}
+
 SpiraloneWidget::SpiraloneWidget()
 {
+	LoadTimer timer("Spiralone instance");
 	color[0] = COLOR_RED;
 	color[1] = COLOR_WHITE;
 	color[2] = COLOR_BLUE;
@@ -55,6 +93,10 @@ SpiraloneWidget::SpiraloneWidget()
 	addChild(createScrew<ScrewSilver>(Vec(RACK_GRID_WIDTH, box.size.y - RACK_GRID_WIDTH)));
 	addChild(createScrew<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, box.size.y - RACK_GRID_WIDTH)));
 
+	// all the step lights in a single widget
+	LedField *leds = new LedField(module);
+	float ledSize = mm2px(Vec(2.176, 2.176)).x;
+
 	int x = 180;
 	int y = 180;
 	float step = 2 * M_PI / TOTAL_STEPS;
@@ -72,17 +114,19 @@ SpiraloneWidget::SpiraloneWidget()
 		{
 			int n = s * TOTAL_STEPS + k;
 			r -= 15;
-			addChild(createLed(s, Vec(x + r * cx + 9.7, y + r * cy + 9.4), module, Spiralone::LED_SEQUENCE_1 + n));
+			leds->Add(Vec(x + r * cx + 9.7, y + r * cy + 9.4), ledSize, color[s], Spiralone::LED_SEQUENCE_1 + n);
 
 			if(k == 0)
 				createSequencer(s);
 		}
 	}
-
+	addChild(leds);
 
 #ifdef LAUNCHPAD
 	addChild(new DigitalLed((box.size.x - 28) / 2 - 32, RACK_GRID_HEIGHT - 28, &module->connected));
 #endif
+
+	build_param_index();
 }
 
 void SpiraloneWidget::createSequencer(int seq)
@@ -127,21 +171,6 @@ void SpiraloneWidget::createSequencer(int seq)
 	addOutput(createOutput<PJ301GPort>(Vec(x, y + 19), module, Spiralone::GATE_1 + seq));
 }
 
-ModuleLightWidget *SpiraloneWidget::createLed(int seq, Vec pos, Module *module, int firstLightId, bool big)
-{
-	ModuleLightWidget * rv = new ModuleLightWidget();
-	if(big)
-		rv->box.size = mm2px(Vec(3, 3));
-	else
-		rv->box.size = mm2px(Vec(2.176, 2.176));
-	rv->box.pos = pos;
-	rv->addBaseColor(color[seq]);
-	rv->module = module;
-	rv->firstLightId = firstLightId;
-	//rv->bgColor = COLOR_BLACK_TRANSPARENT;
-	return rv;
-}
-
 Menu *SpiraloneWidget::addContextMenu(Menu *menu) 
 {
 	menu->addChild(new SeqMenuItem<SpiraloneWidget>("Randomize Pitch", this, RANDOMIZE_PITCH));
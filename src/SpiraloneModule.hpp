@@ -1,6 +1,6 @@
 #pragma once
 
-struct Spiralone : Module
+struct Spiralone : BlockProcessing<Spiralone>
 {
 	enum ParamIds
 	{
@@ -35,7 +35,7 @@ struct Spiralone : Module
 		NUM_LIGHTS = (LED_SEQUENCE_1 + TOTAL_STEPS) * NUM_SEQUENCERS
 	};
 
-	Spiralone() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	Spiralone() : BlockProcessing(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
 	{
 #ifdef LAUNCHPAD
 		drv = new LaunchpadBindingDriver(Scene5, 1);
@@ -50,7 +50,6 @@ struct Spiralone : Module
 	}
 #endif
 
-	void step() override;
 	void reset() override { load(); }
 
 	void fromJson(json_t *root) override { Module::fromJson(root); on_loaded(); }
@@ -66,9 +65,16 @@ struct Spiralone : Module
 #endif
 
 private:
+	friend struct BlockProcessing<Spiralone>;
+	void beginBlock();
+	void process();
+	void endBlock();
+	void updateLights();
+	int nextEvent(const float *const *in, int n, int frames);
 	void on_loaded();
 	void load();
 
 	spiraloneSequencer sequencer[NUM_SEQUENCERS];
+	int seqEvent[NUM_SEQUENCERS];
 
 };
@@ -2,7 +2,7 @@
 #include "z8kSequencer.hpp"
 #include <sstream>
 
-struct Z8K : Module
+struct Z8K : BlockProcessing<Z8K>
 {
 	enum ParamIds
 	{
@@ -57,7 +57,7 @@ struct Z8K : Module
 		NUM_SEQUENCERS
 	};
 
-	Z8K() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	Z8K() : BlockProcessing(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
 	{
 #ifdef LAUNCHPAD
 		drv = new LaunchpadBindingDriver(Scene4, 1);
@@ -73,7 +73,6 @@ struct Z8K : Module
 	}
 #endif
 
-	void step() override;
 	void reset() override { load(); }
 
 	void fromJson(json_t *root) override { Module::fromJson(root); on_loaded(); }
@@ -89,9 +88,16 @@ struct Z8K : Module
 #endif
 
 private:
+	friend struct BlockProcessing<Z8K>;
+	void beginBlock();
+	void process();
+	void endBlock();
+	void updateLights();
+	int nextEvent(const float *const *in, int n, int frames);
 	void on_loaded();
 	void load();
 	z8kSequencer seq[10];
+	int seqEvent[NUM_SEQUENCERS];
 };
 
 void Z8K::on_loaded()
@@ -123,21 +129,68 @@ void Z8K::load()
 	//vert
 	std::vector<int> steps_v = {0,4,8,12,13,9,5,1,2,6,10,14,15,11,7,3};
 	seq[SEQ_VERT].Init(&inputs[RESET_VERT], &inputs[DIR_VERT], &inputs[CLOCK_VERT], &outputs[CV_VERT], &lights[LED_VERT], params, steps_v);
+	markLights();
 }
 
-void Z8K::step()
+void Z8K::process()
 {
 	for(int k = 0; k < NUM_SEQUENCERS; k++)
-		seq[k].Step();
+	{
+		int rv = seq[k].Step();
+		if(rv != 0)
+			markLights();
+#ifdef USE_COUNTERS
+		if(rv < 0)
+			COUNT(this, resets);
+		else if(rv > 0)
+		{
+			COUNT(this, clockEdges);
+			COUNT(this, steps);
+		}
+#endif
+	}
+}
+
+void Z8K::beginBlock()
+{
+	for(int k = 0; k < NUM_SEQUENCERS; k++)
+		seqEvent[k] = -1;
+}
+
+// a sequencer's next event stays valid until it has been processed
+int Z8K::nextEvent(const float *const *in, int n, int frames)
+{
+	int next = frames;
+	for(int k = 0; k < NUM_SEQUENCERS; k++)
+	{
+		if(seqEvent[k] < n)
+			seqEvent[k] = seq[k].NextEvent(buffer(in, RESET_1 + k), buffer(in, CLOCK_1 + k), n, frames);
+		next = std::min(next, seqEvent[k]);
+	}
+	return next;
+}
 
+void Z8K::endBlock()
+{
 #ifdef LAUNCHPAD
 	connected = drv->Connected() ? 1.0 : 0.0;
 	drv->ProcessLaunchpad();
+	COUNT_LAUNCHPAD(this, drv);
 #endif
 }
 
+void Z8K::updateLights()
+{
+	for(int k = 0; k < NUM_SEQUENCERS; k++)
+	{
+		seq[k].ShowLeds();
+		COUNT_N(this, lightWrites, seq[k].NumSteps());
+	}
+}
+
 Z8KWidget::Z8KWidget()
 {
+	LoadTimer timer("Z8K instance");
 	Z8K *module = new Z8K();
 	setModule(module);
 	box.size = Vec(28 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT);
@@ -205,4 +258,6 @@ Z8KWidget::Z8KWidget()
 #ifdef LAUNCHPAD
 	addChild(new DigitalLed((box.size.x - 24) / 2, 5, &module->connected));
 #endif
+
+	build_param_index();
 }
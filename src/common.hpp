@@ -1,8 +1,9 @@
 #pragma once
 #include "rack.hpp"
 #include <algorithm>
-#include <sstream>
-#include <iomanip>
+#include <chrono>
+#include <string.h>
+#include "counters.hpp"
 
 #define LVL_ON    (10.0)
 #define LVL_OFF   (0.0)
@@ -20,6 +21,225 @@ extern Plugin *plugin;
 // #define TEST_MODULE
 #endif
 
+// Block processing: processBlock() renders `frames` samples in one call.
+// in[k] and out[k] are the sample buffers of input k and output k; a NULL
+// buffer (or a NULL array) leaves that port alone.
+struct BlockModule : Module
+{
+	BlockModule(int numParams, int numInputs, int numOutputs, int numLights) : Module(numParams, numInputs, numOutputs, numLights) {}
+	virtual void processBlock(const float *const *in, float *const *out, int frames) = 0;
+
+	// Edge scheduled execution: between two points where the outputs may
+	// change, they are held rather than recomputed. The result is the same.
+	bool edgeScheduling = true;
+
+	// Lights are written at most once every lightDivider samples, and only
+	// after markLights(); 0 writes them at the end of every block that marked.
+	int lightDivider = 512;
+
+#ifdef USE_COUNTERS
+	HotPathCounters counters;
+#endif
+
+protected:
+	void markLights() { lightsDirty = true; }
+	bool lightsDirty = true;
+	int lightCountdown = 0;
+};
+
+// Index of the first frame in [n, frames) where the trigger would change its
+// state. The trigger input is buffer[i] + offset, or value + offset with no buffer.
+template<class TRIGGER> int nextEdge(const TRIGGER &trig, const float *buffer, float value, float offset, int n, int frames)
+{
+	float low = trig.low;
+	float high = trig.high;
+	if(trig.state == TRIGGER::LOW)
+		low = -INFINITY;
+	else if(trig.state == TRIGGER::HIGH)
+		high = INFINITY;
+
+	if(buffer == NULL)
+	{
+		float v = value + offset;
+		return (v <= low || v >= high) ? n : frames;
+	}
+
+	for(int i = n; i < frames; i++)
+	{
+		float v = buffer[i] + offset;
+		if(v <= low || v >= high)
+			return i;
+	}
+	return frames;
+}
+
+// T renders one sample in process(); param reads and sample rate go in
+// beginBlock(), controller I/O in endBlock(), so they run once per block.
+// Light values are written in updateLights(), called after endBlock() when
+// they were marked and the light divider has run out.
+// step() is a single sample block, with identical results.
+// With edge scheduling, T::nextEvent(in, n, frames) returns the first frame
+// from n on that has to be processed; the first frame of a block always is,
+// to pick up param changes.
+template<class T> struct BlockProcessing : BlockModule
+{
+	BlockProcessing(int numParams, int numInputs, int numOutputs, int numLights) : BlockModule(numParams, numInputs, numOutputs, numLights) {}
+
+	void step() override
+	{
+		COUNT_TIME_BEGIN();
+		T *pT = static_cast<T *>(this);
+		pT->beginBlock();
+		pT->process();
+		pT->endBlock();
+		flushLights(1);
+		COUNT_TIME_END(1);
+	}
+
+	void processBlock(const float *const *in, float *const *out, int frames) override
+	{
+		COUNT_TIME_BEGIN();
+		T *pT = static_cast<T *>(this);
+		int numInputs = inputs.size();
+		int numOutputs = outputs.size();
+		pT->beginBlock();
+		for(int n = 0; n < frames;)
+		{
+			if(in != NULL)
+			{
+				for(int k = 0; k < numInputs; k++)
+				{
+					if(in[k] != NULL)
+						inputs[k].value = in[k][n];
+				}
+			}
+
+			pT->process();
+
+			int next = n + 1;
+			if(edgeScheduling && next < frames)
+				next = pT->nextEvent(in, next, frames);
+
+			if(out != NULL)
+			{
+				for(int k = 0; k < numOutputs; k++)
+				{
+					if(out[k] != NULL)
+					{
+						for(int i = n; i < next; i++)
+							out[k][i] = outputs[k].value;
+					}
+				}
+			}
+			n = next;
+		}
+		pT->endBlock();
+		flushLights(frames);
+		COUNT_TIME_END(frames);
+	}
+
+protected:
+	void beginBlock() {}
+	void endBlock() {}
+	void updateLights() {}
+	int nextEvent(const float *const *in, int n, int frames) { return n; }
+	static const float *buffer(const float *const *in, int k) { return in != NULL ? in[k] : NULL; }
+
+private:
+	void flushLights(int frames)
+	{
+		if(lightCountdown > 0)
+			lightCountdown -= frames;
+		if(lightsDirty && lightCountdown <= 0)
+		{
+			lightsDirty = false;
+			lightCountdown = lightDivider;
+			static_cast<T *>(this)->updateLights();
+		}
+	}
+};
+
+// Per-instance random generator (PCG32): every module has its own sequence,
+// saved with the patch, so that a performance can be rendered again exactly.
+// Reset() restarts the sequence from the seed.
+struct RNG
+{
+public:
+	RNG() { Seed(randomu32()); }
+
+	void Seed(uint64_t newSeed)
+	{
+		seed = newSeed;
+		Reset();
+	}
+
+	void Reset()
+	{
+		state = 0;
+		Next();
+		state += seed;
+		Next();
+	}
+
+	uint32_t Next()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + INCREMENT;
+		uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rot = (uint32_t)(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	// uniform in [0, 1)
+	float Uniform() { return (Next() >> 8) * (1.0f / 16777216.0f); }
+
+	json_t *toJson() const
+	{
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "seed", json_integer((long long)seed));
+		json_object_set_new(rootJ, "state", json_integer((long long)state));
+		return rootJ;
+	}
+
+	void fromJson(json_t *rootJ)
+	{
+		json_t *seedJ = json_object_get(rootJ, "seed");
+		json_t *stateJ = json_object_get(rootJ, "state");
+		if(seedJ != NULL && stateJ != NULL)
+		{
+			seed = (uint64_t)json_integer_value(seedJ);
+			state = (uint64_t)json_integer_value(stateJ);
+		}
+	}
+
+private:
+	static const uint64_t INCREMENT = 1442695040888963407ULL;
+	uint64_t seed;
+	uint64_t state;
+};
+
+// Logs the time spent from construction to destruction; put one at the top
+// of a widget constructor.
+struct LoadTimer
+{
+public:
+	LoadTimer(const char *what)
+	{
+		name = what;
+		start = std::chrono::steady_clock::now();
+	}
+
+	~LoadTimer()
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		info("%s: %.2f ms", name, elapsed.count());
+	}
+
+private:
+	const char *name;
+	std::chrono::steady_clock::time_point start;
+};
+
 struct PJ301YPort : SVGPort
 {
 	PJ301YPort()
@@ -180,6 +400,15 @@ struct BefacoSnappedTinyKnob : BefacoTinyKnob
 	void randomize() override { setValue(roundf(rescalef(randomf(), 0.0, 1.0, minValue, maxValue))); }
 };
 
+struct SnappedTrimpot : Trimpot
+{
+	SnappedTrimpot() : Trimpot()
+	{
+		snap = true;
+	}
+	void randomize() override { setValue(roundf(rescalef(randomf(), 0.0, 1.0, minValue, maxValue))); }
+};
+
 struct VerticalSwitch : SVGSlider
 {
 	VerticalSwitch()
@@ -218,25 +447,139 @@ private:
 
 class SequencerWidget : public ModuleWidget
 {
+#ifdef USE_COUNTERS
+public:
+	SequencerWidget() { instances().push_back(this); }
+	~SequencerWidget() { instances().erase(std::find(instances().begin(), instances().end(), this)); }
+
+	// the counters of every instance in the patch, to find the one eating the CPU
+	static json_t *countersToJson()
+	{
+		json_t *rootJ = json_array();
+		for(SequencerWidget *w : instances())
+		{
+			BlockModule *m = dynamic_cast<BlockModule *>(w->module);
+			if(m == NULL)
+				continue;
+			json_t *instJ = json_object();
+			json_object_set_new(instJ, "model", json_string(w->model != NULL ? w->model->slug.c_str() : ""));
+			json_object_set_new(instJ, "x", json_real(w->box.pos.x));
+			json_object_set_new(instJ, "y", json_real(w->box.pos.y));
+			json_object_set_new(instJ, "counters", m->counters.toJson());
+			json_array_append_new(rootJ, instJ);
+		}
+		return rootJ;
+	}
+
+private:
+	static std::vector<SequencerWidget *> &instances()
+	{
+		static std::vector<SequencerWidget *> list;
+		return list;
+	}
+
+	struct CountersMenuItem : MenuItem
+	{
+		enum { RESET, SAVE } action;
+		BlockModule *module;
+		void onAction(EventAction &e) override
+		{
+			if(action == RESET)
+			{
+				module->counters.Reset();
+			} else
+			{
+				std::string path = assetLocal("TheXOR-counters.json");
+				json_t *rootJ = countersToJson();
+				if(json_dump_file(rootJ, path.c_str(), JSON_INDENT(2)) == 0)
+					info("counters saved to %s", path.c_str());
+				else
+					warn("cannot write %s", path.c_str());
+				json_decref(rootJ);
+			}
+		}
+	};
+
+	void addCountersMenu(Menu *menu)
+	{
+		BlockModule *m = dynamic_cast<BlockModule *>(module);
+		if(m == NULL)
+			return;
+		const HotPathCounters &c = m->counters;
+		char text[128];
+		auto label = [&]()
+		{
+			MenuLabel *lbl = new MenuLabel();
+			lbl->text = text;
+			menu->addChild(lbl);
+		};
+
+		menu->addChild(new MenuLabel());
+		snprintf(text, sizeof(text), "Clock edges %llu, resets %llu, steps %llu", (unsigned long long)c.clockEdges, (unsigned long long)c.resets, (unsigned long long)c.steps);
+		label();
+		snprintf(text, sizeof(text), "Launchpad msgs in %llu, out %llu", (unsigned long long)c.lpRead, (unsigned long long)c.lpWritten);
+		label();
+		snprintf(text, sizeof(text), "Light writes %llu", (unsigned long long)c.lightWrites);
+		label();
+		snprintf(text, sizeof(text), "%.1f %s/sample over %llu samples", c.MeanTicks(), HotPathCounters::TickUnit(), (unsigned long long)c.samples);
+		label();
+		for(int k = 0; k < HotPathCounters::TIME_BINS; k++)
+		{
+			if(c.time[k] == 0)
+				continue;
+			snprintf(text, sizeof(text), "  %llu+ %s: %llu", 1ULL << k, HotPathCounters::TickUnit(), (unsigned long long)c.time[k]);
+			label();
+		}
+
+		CountersMenuItem *item = new CountersMenuItem();
+		item->text = "Reset counters";
+		item->action = CountersMenuItem::RESET;
+		item->module = m;
+		menu->addChild(item);
+		item = new CountersMenuItem();
+		item->text = "Save all counters as JSON";
+		item->action = CountersMenuItem::SAVE;
+		item->module = m;
+		menu->addChild(item);
+	}
+#endif
+
 protected:
-	int getParamIndex(int index)
+	// widget bound to the param id, NULL if none; read only, so that the
+	// modules can call it from the audio thread
+	ParamWidget *getParam(int paramId) const
+	{
+		int index = getParamIndex(paramId);
+		return index >= 0 ? params[index] : NULL;
+	}
+
+	int getParamIndex(int paramId) const
 	{
-		auto it = std::find_if(params.begin(), params.end(), [&index](const ParamWidget *m) -> bool { return m->paramId == index; });
-		if(it != params.end())
-			return std::distance(params.begin(), it);
+		return (paramId >= 0 && paramId < (int)paramIndex.size()) ? paramIndex[paramId] : -1;
+	}
 
-		return -1;
+	// the paramId -> widget index: the constructors call it once all their
+	// params have been added
+	void build_param_index()
+	{
+		paramIndex.clear();
+		for(size_t k = 0; k < params.size(); k++)
+		{
+			int id = params[k]->paramId;
+			if(id >= (int)paramIndex.size())
+				paramIndex.resize(id + 1, -1);
+			paramIndex[id] = k;
+		}
 	}
 
+	// randomizes the params first_index..last_index-1, in a single pass over the index
 	void std_randomize(int first_index, int last_index)
 	{
 		for(int k = first_index; k < last_index; k++)
 		{
-			int index = getParamIndex(k);
-			if(index >= 0)
-			{
-				params[index]->randomize();
-			}
+			ParamWidget *pwdg = getParam(k);
+			if(pwdg != NULL)
+				pwdg->randomize();
 		}
 	}
 
@@ -245,10 +588,17 @@ protected:
 		Menu *menu = ModuleWidget::createContextMenu();
 		MenuLabel *spacerLabel = new MenuLabel();
 		menu->addChild(spacerLabel);
-		return addContextMenu(menu);
+		menu = addContextMenu(menu);
+#ifdef USE_COUNTERS
+		addCountersMenu(menu);
+#endif
+		return menu;
 	}
 
 	virtual Menu *addContextMenu(Menu *menu) { return menu; }
+
+private:
+	std::vector<int> paramIndex;
 };
 
 #ifdef LAUNCHPAD
@@ -276,21 +626,127 @@ struct DigitalLed : SVGWidget
 };
 #endif
 
-struct SigDisplayWidget : TransparentWidget
+// A field of single colour lights in one widget. The unlit LEDs are drawn once
+// into a framebuffer; each frame only the lit ones are drawn over it, in one
+// path per colour. A light is either off or fully on (value > 0).
+struct LedField : TransparentWidget
 {
+public:
+	LedField(Module *module)
+	{
+		this->module = module;
+		cache = new FramebufferWidget();
+		background = new Background();
+		background->field = this;
+		cache->addChild(background);
+		addChild(cache);
+	}
+
+	// top left corner and diameter of the LED; the field sits at the origin of its parent
+	void Add(Vec pos, float size, NVGcolor color, int lightId)
+	{
+		Group *group = NULL;
+		for(Group &g : groups)
+		{
+			if(g.color.r == color.r && g.color.g == color.g && g.color.b == color.b && g.color.a == color.a)
+				group = &g;
+		}
+		if(group == NULL)
+		{
+			groups.push_back(Group());
+			group = &groups.back();
+			group->color = color;
+		}
+
+		float radius = size / 2.0;
+		Vec center = pos.plus(Vec(radius, radius));
+		group->leds.push_back(Led{center, radius, lightId});
+		background->box.size.x = std::max(background->box.size.x, center.x + radius);
+		background->box.size.y = std::max(background->box.size.y, center.y + radius);
+		box.size = background->box.size;
+		cache->dirty = true;
+	}
+
+	void draw(NVGcontext *vg) override
+	{
+		Widget::draw(vg);   // the unlit LEDs, from the framebuffer
+
+		for(const Group &g : groups)
+		{
+			bool any = false;
+			nvgBeginPath(vg);
+			for(const Led &l : g.leds)
+			{
+				if(module->lights[l.lightId].value > 0)
+				{
+					nvgCircle(vg, l.center.x, l.center.y, l.radius * 1.6);
+					any = true;
+				}
+			}
+			if(!any)
+				continue;
+			nvgFillColor(vg, nvgTransRGBA(g.color, 0x20));    // glow
+			nvgFill(vg);
+
+			nvgBeginPath(vg);
+			for(const Led &l : g.leds)
+			{
+				if(module->lights[l.lightId].value > 0)
+					nvgCircle(vg, l.center.x, l.center.y, l.radius);
+			}
+			nvgFillColor(vg, g.color);
+			nvgFill(vg);
+		}
+	}
+
 private:
-	int digits;
-	int precision;
+	struct Led
+	{
+		Vec center;
+		float radius;
+		int lightId;
+	};
+
+	struct Group
+	{
+		NVGcolor color;
+		std::vector<Led> leds;
+	};
+
+	struct Background : TransparentWidget
+	{
+		LedField *field;
+		void draw(NVGcontext *vg) override
+		{
+			nvgBeginPath(vg);
+			for(const Group &g : field->groups)
+			{
+				for(const Led &l : g.leds)
+					nvgCircle(vg, l.center.x, l.center.y, l.radius);
+			}
+			nvgFillColor(vg, COLOR_BLACK);
+			nvgFill(vg);
+		}
+	};
+
+	Module *module;
+	std::vector<Group> groups;
+	FramebufferWidget *cache;
+	Background *background;
+};
+
+// Seven segment readout: background, the unlit segments and the text
+struct SegmentDisplay : TransparentWidget
+{
+	char text[16] = "";
+	Vec textPos;
 	std::shared_ptr<Font> font;
 
-public:
-	float *value;
-	SigDisplayWidget(int digit, int precis = 0)
+	SegmentDisplay(Vec pos)
 	{
-		digits = digit;
-		precision = precis;
+		textPos = pos;
 		font = Font::load(assetPlugin(plugin, "res/Segment7Standard.ttf"));
-	};
+	}
 
 	void draw(NVGcontext *vg) override
 	{
@@ -309,14 +765,6 @@ public:
 		nvgFontFaceId(vg, font->handle);
 		nvgTextLetterSpacing(vg, 2.5);
 
-		std::stringstream to_display;
-		if(precision == 0)
-			to_display << std::setw(digits) << std::round(*value);
-		else
-			to_display << std::fixed << std::setw(digits) << std::setprecision(precision) << *value;
-
-		Vec textPos = Vec(3, 17);
-
 		NVGcolor textColor = nvgRGB(0xdf, 0xd2, 0x2c);
 		nvgFillColor(vg, nvgTransRGBA(textColor, 16));
 		nvgText(vg, textPos.x, textPos.y, "~~", NULL);
@@ -327,40 +775,102 @@ public:
 
 		textColor = nvgRGB(0xf0, 0x00, 0x00);
 		nvgFillColor(vg, textColor);
-		nvgText(vg, textPos.x, textPos.y, to_display.str().c_str(), NULL);
+		nvgText(vg, textPos.x, textPos.y, text, NULL);
 	}
 };
 
-struct TIMER
+// A SegmentDisplay drawn into a framebuffer, which is rebuilt only when
+// setText() gets a different text (or the display is resized).
+struct CachedDisplay : FramebufferWidget
 {
-	float Reset()
+public:
+	CachedDisplay(Vec textPos)
+	{
+		face = new SegmentDisplay(textPos);
+		addChild(face);
+	}
+
+	void step() override
+	{
+		if(face->box.size.x != box.size.x || face->box.size.y != box.size.y)
+		{
+			face->box.size = box.size;
+			dirty = true;
+		}
+		FramebufferWidget::step();
+	}
+
+protected:
+	void setText(const char *text)
 	{
-		prevTime = clock();
-		return Begin();
+		if(strcmp(face->text, text))
+		{
+			snprintf(face->text, sizeof(face->text), "%s", text);
+			dirty = true;
+		}
 	}
 
-	void RestartStopWatch() { stopwatch = 0; }
-	float Begin()
+private:
+	SegmentDisplay *face;
+};
+
+struct SigDisplayWidget : CachedDisplay
+{
+private:
+	int digits;
+	int precision;
+	float shown = NAN;
+
+public:
+	float *value;
+	SigDisplayWidget(int digit, int precis = 0) : CachedDisplay(Vec(3, 17))
+	{
+		digits = digit;
+		precision = precis;
+	};
+
+	void step() override
 	{
-		RestartStopWatch();
-		return totalPulseTime = 0;
+		if(*value != shown)
+		{
+			shown = *value;
+			char text[16];
+			if(precision == 0)
+				snprintf(text, sizeof(text), "%*.0f", digits, std::round(shown));
+			else
+				snprintf(text, sizeof(text), "%*.*f", digits, precision, shown);
+			setText(text);
+		}
+		CachedDisplay::step();
 	}
-	float Elapsed() { return totalPulseTime; }
-	float StopWatch() { return stopwatch; }
+};
+
+// Sample clock for step timing: Elapsed() counts the samples since the step
+// began, StopWatch() those since the last clock pulse. Step() advances it by
+// one sample, Skip() by the samples a block did not process.
+struct TIMER
+{
+	void SetSampleRate(float rate) { sampleRate = rate; }
+	float SampleRate() const { return sampleRate; }
+	uint32_t Samples(float seconds) const { return (uint32_t)(seconds * sampleRate); }
 
-	float Step()
+	void Reset()
 	{
-		clock_t curTime = clock();
-		clock_t deltaTime = curTime - prevTime;
-		prevTime = curTime;
-		float t = float(deltaTime) / CLOCKS_PER_SEC;
-		totalPulseTime += t;
-		stopwatch += t;
-		return t;
+		now = 0;
+		Begin();
 	}
 
+	void RestartStopWatch() { pulseStart = now; }
+	void Begin() { stepStart = pulseStart = now; }
+	uint32_t Elapsed() const { return now - stepStart; }
+	uint32_t StopWatch() const { return now - pulseStart; }
+
+	void Step() { now++; }
+	void Skip(int samples) { now += samples; }
+
 private:
-	clock_t prevTime;
-	float totalPulseTime;
-	float stopwatch;
+	float sampleRate = 44100;
+	uint32_t now = 0;
+	uint32_t stepStart = 0;
+	uint32_t pulseStart = 0;
 };
@@ -0,0 +1,109 @@
+#pragma once
+// Hot path counters, compiled in with USE_COUNTERS (FLAGS += -DUSE_COUNTERS):
+// every module counts the clock edges, resets and steps it processed, the
+// launchpad messages and light writes, and keeps a histogram of the time its
+// step() takes per sample. They are shown in the context menu and can be
+// saved as JSON. Without USE_COUNTERS the COUNT macros expand to nothing.
+#include "rack.hpp"
+#include <stdint.h>
+#include <string>
+#ifdef USE_COUNTERS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+using namespace rack;
+
+#ifdef USE_COUNTERS
+#define COUNT(owner, counter) ((owner)->counters.counter++)
+#define COUNT_N(owner, counter, n) ((owner)->counters.counter += (n))
+#define COUNT_TIME_BEGIN() uint64_t countersStart = HotPathCounters::Ticks()
+#define COUNT_TIME_END(frames) counters.AddTime(HotPathCounters::Ticks() - countersStart, frames)
+#define COUNT_LAUNCHPAD(owner, drv) (drv)->TakeMessageCounts(&(owner)->counters.lpRead, &(owner)->counters.lpWritten)
+#else
+#define COUNT(owner, counter) ((void)0)
+#define COUNT_N(owner, counter, n) ((void)0)
+#define COUNT_TIME_BEGIN() ((void)0)
+#define COUNT_TIME_END(frames) ((void)0)
+#define COUNT_LAUNCHPAD(owner, drv) ((void)0)
+#endif
+
+#ifdef USE_COUNTERS
+struct HotPathCounters
+{
+	// bin k counts the step() calls that took [2^k, 2^(k+1)) ticks per sample
+	static const int TIME_BINS = 24;
+
+	uint64_t clockEdges;
+	uint64_t resets;
+	uint64_t steps;
+	uint64_t lpRead;
+	uint64_t lpWritten;
+	uint64_t lightWrites;
+	uint64_t samples;
+	uint64_t ticks;
+	uint64_t time[TIME_BINS];
+
+	HotPathCounters() { Reset(); }
+
+	void Reset()
+	{
+		clockEdges = resets = steps = 0;
+		lpRead = lpWritten = lightWrites = 0;
+		samples = ticks = 0;
+		for(int k = 0; k < TIME_BINS; k++)
+			time[k] = 0;
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	static const char *TickUnit() { return "cycles"; }
+	static uint64_t Ticks() { return __rdtsc(); }
+#else
+	static const char *TickUnit() { return "ns"; }
+	static uint64_t Ticks() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+#endif
+
+	void AddTime(uint64_t elapsed, int frames)
+	{
+		if(frames <= 0)
+			return;
+		samples += frames;
+		ticks += elapsed;
+		uint64_t perSample = elapsed / frames;
+		int bin = 0;
+		while(perSample > 1 && bin < TIME_BINS - 1)
+		{
+			perSample >>= 1;
+			bin++;
+		}
+		time[bin]++;
+	}
+
+	double MeanTicks() const { return samples > 0 ? double(ticks) / samples : 0; }
+
+	json_t *toJson() const
+	{
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "clockEdges", json_integer(clockEdges));
+		json_object_set_new(rootJ, "resets", json_integer(resets));
+		json_object_set_new(rootJ, "steps", json_integer(steps));
+		json_object_set_new(rootJ, "launchpadRead", json_integer(lpRead));
+		json_object_set_new(rootJ, "launchpadWritten", json_integer(lpWritten));
+		json_object_set_new(rootJ, "lightWrites", json_integer(lightWrites));
+		json_object_set_new(rootJ, "samples", json_integer(samples));
+		json_object_set_new(rootJ, "tickUnit", json_string(TickUnit()));
+		json_object_set_new(rootJ, "meanTicksPerSample", json_real(MeanTicks()));
+		json_t *timeJ = json_array();
+		int last = TIME_BINS - 1;
+		while(last > 0 && time[last] == 0)
+			last--;
+		for(int k = 0; k <= last; k++)
+			json_array_append_new(timeJ, json_integer(time[k]));
+		json_object_set_new(rootJ, "timeHistogram", timeJ);
+		return rootJ;
+	}
+};
+#endif
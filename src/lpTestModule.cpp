@@ -48,6 +48,7 @@ void LaunchpadTest::step()
 
 LaunchpadTestWidget::LaunchpadTestWidget()
 {
+	LoadTimer timer("LaunchpadTest instance");
 	LaunchpadTest *module = new LaunchpadTest();
 	setModule(module);
 	box.size = Vec(13 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT);
@@ -2,7 +2,7 @@
 #include "dsp/digital.hpp"
 
 #define OUT_SOCKETS (21)
-struct PwmClock : Module
+struct PwmClock : BlockProcessing<PwmClock>
 {
 	enum ParamIds
 	{
@@ -26,12 +26,11 @@ struct PwmClock : Module
 		NUM_LIGHTS
 	};
 
-	PwmClock() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	PwmClock() : BlockProcessing(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
 	{
 
 		on_loaded();
 	}
-	void step();
 
 	json_t *toJson() override
 	{
@@ -60,6 +59,9 @@ struct PwmClock : Module
 	float bpm;
 
 private:
+	friend struct BlockProcessing<PwmClock>;
+	void beginBlock();
+	void process();
 	SchmittTrigger btnup;
 	SchmittTrigger btndwn;
 	PwmClockWidget *pWidget;
@@ -86,6 +88,8 @@ private:
 		}
 	}
 	float duration[OUT_SOCKETS];
+	float gate_len[OUT_SOCKETS];
+	float sampleTime;
 	void on_loaded();
 	void load();
 	SA_TIMER sa_timer[OUT_SOCKETS];
@@ -96,7 +100,7 @@ void PwmClock::on_loaded()
 	bpm = 0;
 	for(int k = 0; k < OUT_SOCKETS; k++)
 	{
-		sa_timer[k].Reset();
+		sa_timer[k].Reset(engineGetSampleTime());
 	}
 	load();
 }
@@ -123,22 +127,28 @@ void PwmClock::process_keys()
 	}
 }
 
-void PwmClock::step()
+void PwmClock::beginBlock()
 {
 	process_keys();
 	bpm_integer = roundf(params[BPM].value);
 	updateBpm();
-	
+	sampleTime = engineGetSampleTime();
+	for(int k = 0; k < OUT_SOCKETS; k++)
+		gate_len[k] = duration[k] * params[PWM].value;
+}
+
+void PwmClock::process()
+{
 	for(int k = 0; k < OUT_SOCKETS; k++)
 	{
-		float gate_len = duration[k] * params[PWM].value;
-		sa_timer[k].Step();
+		sa_timer[k].Step(sampleTime);
 		float elps = sa_timer[k].Elapsed();
 		if(elps >= duration[k])
 		{
-			elps = sa_timer[k].Reset();
+			COUNT(this, steps);
+			elps = sa_timer[k].Reset(sampleTime);
 		}
-		if(elps <= gate_len)
+		if(elps <= gate_len[k])
 			outputs[OUT_1 + k].value = LVL_ON;
 		else
 			outputs[OUT_1 + k].value = LVL_OFF;
@@ -147,6 +157,7 @@ void PwmClock::step()
 
 PwmClockWidget::PwmClockWidget()
 {
+	LoadTimer timer("PWMClock instance");
 	PwmClock *module = new PwmClock();
 	setModule(module);
 	module->setWidget(this);
@@ -202,10 +213,11 @@ PwmClockWidget::PwmClockWidget()
 			row++;
 		}
 	}
+
+	build_param_index();
 }
 
 void PwmClockWidget::SetBpm(float bpm_integer)
 {
-	int index = getParamIndex(PwmClock::BPM);
-	params[index]->setValue(bpm_integer);
+	getParam(PwmClock::BPM)->setValue(bpm_integer);
 }
\ No newline at end of file
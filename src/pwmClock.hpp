@@ -9,9 +9,9 @@ struct PwmClockWidget : SequencerWidget
 
 struct SA_TIMER	//sample accurate version
 {
-	float Reset()
+	float Reset(float sampleTime)
 	{
-		prevTime = curTime = engineGetSampleTime();
+		prevTime = curTime = sampleTime;
 		return Begin();
 	}
 
@@ -24,9 +24,9 @@ struct SA_TIMER	//sample accurate version
 	float Elapsed() { return totalPulseTime; }
 	float StopWatch() { return stopwatch; }
 
-	float Step()
+	float Step(float sampleTime)
 	{
-		curTime += engineGetSampleTime();
+		curTime += sampleTime;
 		float deltaTime = curTime - prevTime;
 		prevTime = curTime;
 		totalPulseTime += deltaTime;
@@ -58,14 +58,16 @@ public:
 		return clk;
 	}
 
-	void Gate(int clk, Output *output, Light *led)
+	int NextEdge(const float *clock, float value, int n, int frames) { return nextEdge(clockTrig, clock, value, 0.0, n, frames); }
+
+	void Gate(int clk, Output *output)
 	{
 		if(clk == 1)  // rise
 		{
-			led->value = output->value = LVL_ON;
+			output->value = LVL_ON;
 		} else if(clk == -1) // fall
 		{
-			led->value = output->value = LVL_OFF;
+			output->value = LVL_OFF;
 		}
 	}
 
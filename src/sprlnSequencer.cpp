@@ -6,13 +6,16 @@ extern float AccessParam(Spiralone *p, int seq, int id);
 extern float AccessParam(Spiralone *p, int id);
 extern Input *AccessInput(Spiralone *p, int seq, int id);
 extern float *AccessOutput(Spiralone *p, int seq, int id);
-extern float *AccessLight(Spiralone *p, int id);
 
-void spiraloneSequencer::Step(int seq, Spiralone *pSpir)
+// -1 on a reset, 1 when the clock moved the sequence on
+int spiraloneSequencer::Step(int seq, Spiralone *pSpir)
 {
 	if(resetTrigger.process(AccessInput(pSpir, seq, Spiralone::RESET_1)->value))
+	{
+		COUNT(pSpir, resets);
 		Reset(seq, pSpir);
-	else
+		return -1;
+	} else
 	{
 		int clk = clockTrig.process(AccessInput(pSpir, seq, Spiralone::CLOCK_1)->value); // 1=rise, -1=fall
 		if(clk == 1)
@@ -20,8 +23,9 @@ void spiraloneSequencer::Step(int seq, Spiralone *pSpir)
 			int mode = (int)std::roundf(AccessParam(pSpir, seq, Spiralone::MODE_1));
 			int numSteps = getInput(seq, pSpir, Spiralone::INLENGHT_1, Spiralone::LENGHT_1, 1.0, TOTAL_STEPS);
 			int stride = getInput(seq, pSpir, Spiralone::INSTRIDE_1, Spiralone::STRIDE_1, 1.0, 8.0);
+			COUNT(pSpir, clockEdges);
+			COUNT(pSpir, steps);
 
-			*AccessLight(pSpir, ledID(seq)) = 0.0;
 			switch(mode)
 			{
 			case 0: // fwd:
@@ -39,16 +43,23 @@ void spiraloneSequencer::Step(int seq, Spiralone *pSpir)
 
 			outputVoltage(seq, pSpir);
 			gate(clk, seq, pSpir);
+			return 1;
 		} else if(clk == -1)
 			gate(clk, seq, pSpir);
 	}
+	return 0;
+}
+
+int spiraloneSequencer::NextEvent(int seq, Spiralone *pSpir, const float *reset, const float *clock, int n, int frames)
+{
+	int next = nextEdge(resetTrigger, reset, AccessInput(pSpir, seq, Spiralone::RESET_1)->value, 0.0, n, frames);
+	return nextEdge(clockTrig, clock, AccessInput(pSpir, seq, Spiralone::CLOCK_1)->value, 0.0, n, next);
 }
 
 void spiraloneSequencer::Reset(int seq, Spiralone *pSpir)
 {
 	curPos = 0;
-	for(int k = 0; k < TOTAL_STEPS; k++)
-		*AccessLight(pSpir, ledID(seq, k)) = 0.0;
+	lit = false;
 }
 
 int spiraloneSequencer::getInput(int seq, Spiralone *pSpir, int input_id, int knob_id, float minValue, float maxValue)
@@ -71,7 +82,7 @@ void spiraloneSequencer::gate(int clk, int seq, Spiralone *pSpir)
 {
 	if(clk == 1)
 	{
-		*AccessLight(pSpir, ledID(seq)) = 10.0;
+		lit = true;
 		*AccessOutput(pSpir, seq, Spiralone::GATE_1) = LVL_ON;
 	} else if(clk == -1) // fall
 	{
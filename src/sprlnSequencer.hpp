@@ -5,15 +5,17 @@ struct spiraloneSequencer
 {
 public:
 	void Reset(int seq, Spiralone *pSpir);
-	void Step(int seq, Spiralone *pSpir);
+	int Step(int seq, Spiralone *pSpir);
+	int NextEvent(int seq, Spiralone *pSpir, const float *reset, const float *clock, int n, int frames);
+	int Position() { return curPos; }
+	bool Lit() { return lit; }
 
 private:
 	SchmittTrigger2 clockTrig;
 	SchmittTrigger resetTrigger;
 	int curPos;
+	bool lit;	// the led of curPos is on from the clock rise to the next reset
 
-	int ledID(int seq) { return ledID(seq, curPos); }
-	int ledID(int seq, int n) { return seq * TOTAL_STEPS + n; }
 	int getInput(int seq, Spiralone *pSpir, int input_id, int knob_id, float minValue, float maxValue);
 	void gate(int clk, int seq, Spiralone *pSpir);
 	void outputVoltage(int seq, Spiralone *pSpir);
@@ -17,12 +17,17 @@ public:
 		}
 	}
 
-	void Step()
+	// -1 on a reset, 1 when the clock moved the sequence on
+	int Step()
 	{
+		int rv = 0;
 		if(resetTrigger.process(pReset->value))
+		{
 			curStep = 0;
-		else if(clockTrigger.process(pClock->value))
+			rv = -1;
+		} else if(clockTrigger.process(pClock->value))
 		{
+			rv = 1;
 			if(pDirection->value > 5)
 			{
 				if(--curStep < 0)
@@ -35,6 +40,20 @@ public:
 		}
 
 		pOutput->value = sequence[curStep]->value;
+		return rv;
+	}
+
+	// first frame from n on where a reset or a clock may come in
+	int NextEvent(const float *reset, const float *clock, int n, int frames)
+	{
+		int next = nextEdge(resetTrigger, reset, pReset->value, 0.0, n, frames);
+		return nextEdge(clockTrigger, clock, pClock->value, 0.0, n, next);
+	}
+
+	int NumSteps() { return numSteps; }
+
+	void ShowLeds()
+	{
 		for(int k = 0; k < numSteps; k++)
 			leds[k]->value = k == curStep ? 10.0 : 0;
 	}